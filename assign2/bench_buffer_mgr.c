@@ -0,0 +1,763 @@
+#include "storage_mgr.h"
+#include "buffer_mgr.h"
+#include "dberror.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// page file used by all benchmarks, removed again at the end
+#define BENCH_FILE "benchbuffer.bin"
+
+// number of timed pin/unpin pairs per measurement
+#define BENCH_OPS 2000000
+
+// number of timed misses per pool size in benchMissLatency
+#define BENCH_MISSES 100000
+
+// number of pins in each trace of benchHitRatio
+#define TRACE_OPS 1000000
+
+// number of pins in each trace of benchPrefetcher
+#define PREFETCH_OPS 200000
+
+// pages one probe batch of benchProbes looks up, and the number of batches
+#define PROBE_BATCH 64
+#define PROBE_BATCHES 2000
+
+// number of pins in each run of benchBackgroundWriter
+#define WRITER_OPS 200000
+
+// keeps the page reads of timeMisses from being optimized away
+static volatile long pageSum;
+
+// benchmarks
+static void benchHitLatency (int maxFrames);
+static void benchMissLatency (int maxFrames);
+static void benchHugePages (int numFrames);
+static void benchFlush (int numFrames);
+static void benchMapped (int numPages, int numFrames);
+static void benchHitRatio (int numFrames);
+static void benchReadAhead (int numPages, int numFrames);
+static void benchPrefetcher (int numPages, int numFrames);
+static void benchProbes (int numPages, int numFrames);
+static void benchBackgroundWriter (int numPages, int numFrames);
+
+// helpers
+static double timeHits (int numFrames, const BM_PoolOptions *options);
+static double timeMissesLRU (int numFrames);
+static double timeFlush (int numFrames, const BM_PoolOptions *options);
+static double timeMisses (int numPages, int numFrames, const BM_PoolOptions *options, int *reads);
+static double timeScan (int numPages, int numFrames, const BM_PoolOptions *options, int *hits, int *wasted);
+static double hitRatio (const PageNumber *trace, int numFrames, ReplacementStrategy strategy, bool admission);
+static void makeTrace (PageNumber *trace, int hotPages, int scanEvery, int scanLength);
+static double replayTrace (const PageNumber *trace, int numFrames, const BM_PoolOptions *options, int *reads, int *hits, int *wasted);
+static void makePrefetchTrace (PageNumber *trace, int kind, int numPages);
+static double timeProbes (int numPages, int numFrames, const BM_PoolOptions *options, bool prefetch);
+static double timeWrites (int numPages, int numFrames, const BM_PoolOptions *options, int *syncWrites, int *writes);
+static double nowNs (void);
+static unsigned int nextRandom (unsigned int *state);
+static void createBenchFile (int numPages);
+static void writeBenchFile (int numPages);
+
+// usage: bench [maxFrames]
+int
+main (int argc, char **argv)
+{
+  int maxFrames = (argc > 1) ? atoi(argv[1]) : (1 << 20);
+
+  initStorageManager();
+
+  benchHitLatency(maxFrames);
+  benchMissLatency(maxFrames);
+  benchHugePages(maxFrames);
+  benchFlush(10000);
+  benchMapped(65536, 4096);
+  benchHitRatio(2048);
+  benchReadAhead(65536, 4096);
+  benchPrefetcher(65536, 1024);
+  benchProbes(65536, 1024);
+  benchBackgroundWriter(16384, 1024);
+
+  destroyPageFile(BENCH_FILE);
+  return 0;
+}
+
+// pin/unpin latency for pages that are already in the pool, for growing pool sizes
+void
+benchHitLatency (int maxFrames)
+{
+  int numFrames;
+  double nsPerHit;
+
+  printf("%-12s %14s\n", "frames", "ns/hit");
+  for (numFrames = 16; numFrames <= maxFrames; numFrames *= 4)
+    {
+      nsPerHit = timeHits(numFrames, NULL);
+      printf("%-12i %14.1f\n", numFrames, nsPerHit);
+    }
+}
+
+// LRU miss latency for growing pool sizes: finding the victim must not depend on the pool size
+void
+benchMissLatency (int maxFrames)
+{
+  int numFrames;
+  double nsPerMiss;
+
+  printf("\n%-12s %14s\n", "frames", "LRU ns/miss");
+  for (numFrames = 16; numFrames <= maxFrames; numFrames *= 4)
+    {
+      nsPerMiss = timeMissesLRU(numFrames);
+      printf("%-12i %14.1f\n", numFrames, nsPerMiss);
+    }
+}
+
+// pin/unpin latency of a large pool with frame memory on normal and on huge pages
+void
+benchHugePages (int numFrames)
+{
+  BM_PoolOptions options;
+  double smallPages, hugePages;
+
+  initPoolOptions(&options);
+  smallPages = timeHits(numFrames, &options);
+  options.hugePages = true;
+  hugePages = timeHits(numFrames, &options);
+
+  printf("\n%-12s %14s %14s\n", "frames", "4K ns/hit", "huge ns/hit");
+  printf("%-12i %14.1f %14.1f\n", numFrames, smallPages, hugePages);
+}
+
+// time to flush a pool whose frames are all dirty, per I/O engine, buffered and with O_DIRECT
+void
+benchFlush (int numFrames)
+{
+  BM_PoolOptions options;
+  double ms[2][2];
+  int direct, threads;
+
+  initPoolOptions(&options);
+  for (direct = 0; direct < 2; direct++)
+    for (threads = 0; threads < 2; threads++)
+      {
+        options.directIO = direct;
+        options.ioEngine = threads ? IO_ENGINE_THREADS : IO_ENGINE_AUTO;
+        ms[direct][threads] = timeFlush(numFrames, &options) / 1e6;
+      }
+
+  printf("\n%-12s %14s %14s %14s\n", "dirty pages", "engine", "buffered ms", "direct ms");
+  printf("%-12i %14s %14.1f %14.1f\n", numFrames, "auto", ms[0][0], ms[1][0]);
+  printf("%-12i %14s %14.1f %14.1f\n", numFrames, "threads", ms[0][1], ms[1][1]);
+}
+
+// random pins over a page file 16 times larger than the pool, frame based and memory mapped
+void
+benchMapped (int numPages, int numFrames)
+{
+  BM_PoolOptions options;
+  double framesNs, mappedNs;
+  int framesReads, mappedReads;
+
+  initPoolOptions(&options);
+  framesNs = timeMisses(numPages, numFrames, &options, &framesReads);
+  options.mmapPages = true;
+  mappedNs = timeMisses(numPages, numFrames, &options, &mappedReads);
+
+  printf("\n%i frames over %i pages\n", numFrames, numPages);
+  printf("%-12s %14s %14s\n", "pool", "ns/pin", "reads");
+  printf("%-12s %14.1f %14i\n", "frames", framesNs, framesReads);
+  printf("%-12s %14.1f %14i\n", "mmap", mappedNs, mappedReads);
+}
+
+// a scan over the whole page file with O_DIRECT, so every miss goes to the disk, without
+// and with read-ahead
+void
+benchReadAhead (int numPages, int numFrames)
+{
+  BM_PoolOptions options;
+  double ns[2];
+  int hits[2], wasted[2], on;
+
+  initPoolOptions(&options);
+  options.directIO = true;
+  for (on = 0; on < 2; on++)
+    {
+      options.readAhead = on;
+      ns[on] = timeScan(numPages, numFrames, &options, &hits[on], &wasted[on]);
+    }
+
+  printf("\n%i frames, scan over %i pages\n", numFrames, numPages);
+  printf("%-12s %14s %14s %14s\n", "read-ahead", "ns/pin", "prefetch hits", "wasted");
+  printf("%-12s %14.1f %14i %14i\n", "off", ns[0], hits[0], wasted[0]);
+  printf("%-12s %14.1f %14i %14i\n", "on", ns[1], hits[1], wasted[1]);
+}
+
+// replays traces of short and long strided walks, of pages that always follow one another
+// and of random pins with O_DIRECT, without and with the stride and correlation prefetcher
+void
+benchPrefetcher (int numPages, int numFrames)
+{
+  const char *traces[] = { "stride", "pairs", "random", "scan" };
+  PageNumber *trace = malloc(sizeof(PageNumber) * PREFETCH_OPS);
+  BM_PoolOptions options;
+  double ns[2];
+  int reads[2], hits[2], wasted[2], kind, on;
+
+  writeBenchFile(numPages);
+  initPoolOptions(&options);
+  options.directIO = true;
+  printf("\n%i frames, %i pins over %i pages\n", numFrames, PREFETCH_OPS, numPages);
+  printf("%-12s %14s %14s %14s %14s %14s\n", "trace", "ns/pin off", "ns/pin on", "reads off", "reads on", "hits/wasted");
+  for (kind = 0; kind < 4; kind++)
+    {
+      makePrefetchTrace(trace, kind, numPages);
+      for (on = 0; on < 2; on++)
+        {
+          options.prefetcher = on;
+          ns[on] = replayTrace(trace, numFrames, &options, &reads[on], &hits[on], &wasted[on]);
+        }
+      printf("%-12s %14.1f %14.1f %14i %14i %7i/%-6i\n", traces[kind], ns[0], ns[1], reads[0], reads[1], hits[1], wasted[1]);
+    }
+  free(trace);
+}
+
+// batches of random page lookups that read every cache line of the page, like probes of an
+// index, with O_DIRECT on both engines, without and with prefetchPages for each batch
+void
+benchProbes (int numPages, int numFrames)
+{
+  BM_PoolOptions options;
+  double ns[2][2];
+  int engine, on;
+
+  createBenchFile(numPages);
+  initPoolOptions(&options);
+  options.directIO = true;
+  for (engine = 0; engine < 2; engine++)
+    {
+      options.ioEngine = engine ? IO_ENGINE_THREADS : IO_ENGINE_AUTO;
+      for (on = 0; on < 2; on++)
+        ns[engine][on] = timeProbes(numPages, numFrames, &options, on);
+    }
+
+  printf("\n%i frames, %i batches of %i random pins over %i pages\n", numFrames, PROBE_BATCHES, PROBE_BATCH, numPages);
+  printf("%-12s %14s %14s\n", "engine", "ns/pin", "prefetched");
+  printf("%-12s %14.1f %14.1f\n", "auto", ns[0][0], ns[0][1]);
+  printf("%-12s %14.1f %14.1f\n", "threads", ns[1][0], ns[1][1]);
+}
+
+// random pins with O_DIRECT that change every second page they pin, without the background
+// writer, with its defaults, and with rounds every 10 ms of up to 256 pages
+void
+benchBackgroundWriter (int numPages, int numFrames)
+{
+  const char *rows[] = { "off", "default", "10 ms, 256" };
+  BM_PoolOptions options;
+  double ns;
+  int syncWrites, writes, row;
+
+  createBenchFile(numPages);
+  initPoolOptions(&options);
+  options.directIO = true;
+  printf("\n%i frames, %i random pins over %i pages, half of them writes\n", numFrames, WRITER_OPS, numPages);
+  printf("%-12s %14s %14s %14s\n", "writer", "ns/pin", "sync writes", "writes");
+  for (row = 0; row < 3; row++)
+    {
+      options.backgroundWriter = row > 0;
+      if (row == 2)
+        {
+          options.bgWriterDelay = 10;
+          options.bgWriterMaxPages = 256;
+        }
+      ns = timeWrites(numPages, numFrames, &options, &syncWrites, &writes);
+      printf("%-12s %14.1f %14i %14i\n", rows[row], ns, syncWrites, writes);
+    }
+}
+
+// hit ratio of each replacement strategy on a zipfian trace over 8 times as many hot pages
+// as frames, alone and with a scan of 4 times the pool size after every 50000 pins, the
+// latter also with the TinyLFU admission filter
+void
+benchHitRatio (int numFrames)
+{
+  const ReplacementStrategy strategies[] = { RS_LRU, RS_LFU, RS_CLOCK, RS_LRU_K, RS_ARC, RS_2Q };
+  const char *names[] = { "LRU", "LFU", "CLOCK", "LRU-K", "ARC", "2Q" };
+  const int numStrategies = sizeof(strategies) / sizeof(strategies[0]);
+  PageNumber *trace = malloc(sizeof(PageNumber) * TRACE_OPS);
+  int hotPages = 8 * numFrames, numPages = 64 * numFrames;
+  const char *traces[] = { "zipf", "zipf+scan", "+TinyLFU" };
+  double ratios[3][6];
+  int row, i;
+
+  createBenchFile(numPages);
+  makeTrace(trace, hotPages, 0, 4 * numFrames);
+  for (i = 0; i < numStrategies; i++)
+    ratios[0][i] = hitRatio(trace, numFrames, strategies[i], false);
+  makeTrace(trace, hotPages, 50000, 4 * numFrames);
+  for (i = 0; i < numStrategies; i++)
+    {
+      ratios[1][i] = hitRatio(trace, numFrames, strategies[i], false);
+      ratios[2][i] = hitRatio(trace, numFrames, strategies[i], true);
+    }
+
+  printf("\n%i frames, hit ratio\n%-12s", numFrames, "trace");
+  for (i = 0; i < numStrategies; i++)
+    printf(" %8s", names[i]);
+  for (row = 0; row < 3; row++)
+    {
+      printf("\n%-12s", traces[row]);
+      for (i = 0; i < numStrategies; i++)
+        printf(" %8.3f", ratios[row][i]);
+    }
+  printf("\n");
+  free(trace);
+}
+
+// share of the pins of trace that found their page in a pool of numFrames frames, pins
+// served from the bypass frame of the admission filter count as misses
+double
+hitRatio (const PageNumber *trace, int numFrames, ReplacementStrategy strategy, bool admission)
+{
+  BM_BufferPool *bm = MAKE_POOL();
+  BM_PageHandle *h = MAKE_PAGE_HANDLE();
+  BM_PoolOptions options;
+  int i, reads;
+
+  initPoolOptions(&options);
+  options.admissionFilter = admission;
+  CHECK(initBufferPoolWithOptions(bm, BENCH_FILE, numFrames, strategy, NULL, &options));
+  for (i = 0; i < TRACE_OPS; i++)
+    {
+      CHECK(pinPage(bm, h, trace[i]));
+      CHECK(unpinPage(bm, h));
+    }
+  reads = getNumReadIO(bm);
+
+  CHECK(shutdownBufferPool(bm));
+  free(bm);
+  free(h);
+  return 1.0 - (double) reads / TRACE_OPS;
+}
+
+// time per pin of PREFETCH_OPS pins of trace, each reading one byte of every cache line of
+// its page, with the reads and the prefetch counters
+double
+replayTrace (const PageNumber *trace, int numFrames, const BM_PoolOptions *options, int *reads, int *hits, int *wasted)
+{
+  BM_BufferPool *bm = MAKE_POOL();
+  BM_PageHandle *h = MAKE_PAGE_HANDLE();
+  double start, elapsed;
+  long sum = 0;
+  int i, j;
+
+  CHECK(initBufferPoolWithOptions(bm, BENCH_FILE, numFrames, RS_LRU, NULL, options));
+  start = nowNs();
+  for (i = 0; i < PREFETCH_OPS; i++)
+    {
+      CHECK(pinPage(bm, h, trace[i]));
+      for (j = 0; j < PAGE_SIZE; j += 64)
+        sum += h->data[j];
+      CHECK(unpinPage(bm, h));
+    }
+  elapsed = nowNs() - start;
+  pageSum = sum;
+  *reads = getNumReadIO(bm);
+  *hits = getNumPrefetchHits(bm);
+  *wasted = getNumPrefetchWasted(bm);
+
+  CHECK(shutdownBufferPool(bm));
+  free(bm);
+  free(h);
+  return elapsed / PREFETCH_OPS;
+}
+
+// time per pin of PROBE_BATCHES batches of PROBE_BATCH random pins, each reading one byte
+// of every cache line of its page.
+// With prefetch the pages of a batch are passed to prefetchPages before the first pin.
+double
+timeProbes (int numPages, int numFrames, const BM_PoolOptions *options, bool prefetch)
+{
+  BM_BufferPool *bm = MAKE_POOL();
+  BM_PageHandle *h = MAKE_PAGE_HANDLE();
+  PageNumber batch[PROBE_BATCH];
+  unsigned int seed = 11;
+  double start, elapsed;
+  long sum = 0;
+  int b, i, j;
+
+  CHECK(initBufferPoolWithOptions(bm, BENCH_FILE, numFrames, RS_LRU, NULL, options));
+  start = nowNs();
+  for (b = 0; b < PROBE_BATCHES; b++)
+    {
+      for (i = 0; i < PROBE_BATCH; i++)
+        batch[i] = nextRandom(&seed) % numPages;
+      if (prefetch)
+        CHECK(prefetchPages(bm, batch, PROBE_BATCH));
+      for (i = 0; i < PROBE_BATCH; i++)
+        {
+          CHECK(pinPage(bm, h, batch[i]));
+          for (j = 0; j < PAGE_SIZE; j += 64)
+            sum += h->data[j];
+          CHECK(unpinPage(bm, h));
+        }
+    }
+  elapsed = nowNs() - start;
+  pageSum = sum;
+
+  CHECK(shutdownBufferPool(bm));
+  free(bm);
+  free(h);
+  return elapsed / (PROBE_BATCHES * PROBE_BATCH);
+}
+
+// time per pin of WRITER_OPS random pins that read every cache line of their page, every
+// second one also changing it, with the misses that wrote their victim and all writes
+double
+timeWrites (int numPages, int numFrames, const BM_PoolOptions *options, int *syncWrites, int *writes)
+{
+  BM_BufferPool *bm = MAKE_POOL();
+  BM_PageHandle *h = MAKE_PAGE_HANDLE();
+  unsigned int seed = 13;
+  double start, elapsed;
+  long sum = 0;
+  int i, j;
+
+  CHECK(initBufferPoolWithOptions(bm, BENCH_FILE, numFrames, RS_LRU, NULL, options));
+  start = nowNs();
+  for (i = 0; i < WRITER_OPS; i++)
+    {
+      CHECK(pinPage(bm, h, nextRandom(&seed) % numPages));
+      for (j = 0; j < PAGE_SIZE; j += 64)
+        sum += h->data[j];
+      if (i % 2 == 0)
+        {
+          h->data[0]++;
+          CHECK(markDirty(bm, h));
+        }
+      CHECK(unpinPage(bm, h));
+    }
+  elapsed = nowNs() - start;
+  pageSum = sum;
+  *syncWrites = getNumSyncWrites(bm);
+  *writes = getNumWriteIO(bm);
+
+  CHECK(shutdownBufferPool(bm));
+  free(bm);
+  free(h);
+  return elapsed / WRITER_OPS;
+}
+
+// PREFETCH_OPS pins of one kind of pattern: 0 walks of 32 pages with a stride of 2 to 9
+// from random pages, like leaf walks of a B-tree; 1 lookups of one of 4096 random pairs,
+// each pinning a key page and then its own heap page; 2 pins of random pages; 3 walks of
+// 512 pages with a stride of 1 to 4, like range scans
+void
+makePrefetchTrace (PageNumber *trace, int kind, int numPages)
+{
+  PageNumber *pairs = malloc(sizeof(PageNumber) * 2 * 4096);
+  unsigned int seed = 7;
+  int i = 0, j, start, stride;
+
+  for (j = 0; j < 2 * 4096; j++)
+    pairs[j] = nextRandom(&seed) % numPages;
+  while (i < PREFETCH_OPS)
+    {
+      if (kind == 0)
+        {
+          stride = 2 + nextRandom(&seed) % 8;
+          start = nextRandom(&seed) % (numPages - 32 * stride);
+          for (j = 0; j < 32 && i < PREFETCH_OPS; j++)
+            trace[i++] = start + j * stride;
+        }
+      else if (kind == 1)
+        {
+          j = nextRandom(&seed) % 4096;
+          trace[i++] = pairs[2 * j];
+          if (i < PREFETCH_OPS)
+            trace[i++] = pairs[2 * j + 1];
+        }
+      else if (kind == 2)
+        trace[i++] = nextRandom(&seed) % numPages;
+      else
+        {
+          stride = 1 + nextRandom(&seed) % 4;
+          start = nextRandom(&seed) % (numPages - 512 * stride);
+          for (j = 0; j < 512 && i < PREFETCH_OPS; j++)
+            trace[i++] = start + j * stride;
+        }
+    }
+  free(pairs);
+}
+
+// TRACE_OPS pins of pages 0 .. hotPages-1 drawn from a zipfian distribution (page i with
+// weight 1 / (i + 1)). With scanEvery > 0 a scan of scanLength pages that are not hot
+// follows every scanEvery of those pins, each scan starting where the last one ended.
+void
+makeTrace (PageNumber *trace, int hotPages, int scanEvery, int scanLength)
+{
+  double *cdf = malloc(sizeof(double) * hotPages);
+  unsigned int seed = 42;
+  int i, lo, hi, mid, sincePin = 0, nextScanned = 0;
+  double sum = 0, u;
+
+  for (i = 0; i < hotPages; i++)
+    cdf[i] = sum += 1.0 / (i + 1);
+
+  i = 0;
+  while (i < TRACE_OPS)
+    {
+      if (scanEvery > 0 && sincePin == scanEvery)
+        {
+          for (mid = 0; mid < scanLength && i < TRACE_OPS; mid++)
+            trace[i++] = hotPages + nextScanned++ % (7 * hotPages);
+          sincePin = 0;
+          continue;
+        }
+
+      // first page whose cumulative weight reaches a uniform draw
+      u = (double) nextRandom(&seed) / 4294967296.0 * sum;
+      lo = 0;
+      hi = hotPages - 1;
+      while (lo < hi)
+        {
+          mid = (lo + hi) / 2;
+          if (cdf[mid] < u)
+            lo = mid + 1;
+          else
+            hi = mid;
+        }
+      trace[i++] = lo;
+      sincePin++;
+    }
+  free(cdf);
+}
+
+// average time of a random pin, a read of the page and an unpin on a pool smaller than
+// the file. Every page is pinned once up front so the file sits in the page cache.
+double
+timeMisses (int numPages, int numFrames, const BM_PoolOptions *options, int *reads)
+{
+  BM_BufferPool *bm = MAKE_POOL();
+  BM_PageHandle *h = MAKE_PAGE_HANDLE();
+  PageNumber *pages = malloc(sizeof(PageNumber) * BENCH_OPS);
+  unsigned int seed = 42;
+  double start, elapsed;
+  long sum = 0;
+  int i;
+
+  createBenchFile(numPages);
+  CHECK(initBufferPoolWithOptions(bm, BENCH_FILE, numFrames, RS_CLOCK, NULL, options));
+  for (i = 0; i < numPages; i++)
+    {
+      CHECK(pinPage(bm, h, i));
+      CHECK(unpinPage(bm, h));
+    }
+  *reads = getNumReadIO(bm);
+
+  for (i = 0; i < BENCH_OPS; i++)
+    pages[i] = nextRandom(&seed) % numPages;
+
+  start = nowNs();
+  for (i = 0; i < BENCH_OPS; i++)
+    {
+      pinPage(bm, h, pages[i]);
+      sum += h->data[0] + h->data[PAGE_SIZE - 1];
+      unpinPage(bm, h);
+    }
+  elapsed = nowNs() - start;
+  *reads = getNumReadIO(bm) - *reads;
+  pageSum = sum;
+
+  CHECK(shutdownBufferPool(bm));
+  free(pages);
+  free(bm);
+  free(h);
+  return elapsed / BENCH_OPS;
+}
+
+// time per pin of one pass over the page file in page order
+double
+timeScan (int numPages, int numFrames, const BM_PoolOptions *options, int *hits, int *wasted)
+{
+  BM_BufferPool *bm = MAKE_POOL();
+  BM_PageHandle *h = MAKE_PAGE_HANDLE();
+  double start, elapsed;
+  long sum = 0;
+  int i;
+
+  createBenchFile(numPages);
+  CHECK(initBufferPoolWithOptions(bm, BENCH_FILE, numFrames, RS_LRU, NULL, options));
+  start = nowNs();
+  for (i = 0; i < numPages; i++)
+    {
+      CHECK(pinPage(bm, h, i));
+      sum += h->data[0];
+      CHECK(unpinPage(bm, h));
+    }
+  elapsed = nowNs() - start;
+  pageSum = sum;
+  *hits = getNumPrefetchHits(bm);
+  *wasted = getNumPrefetchWasted(bm);
+
+  CHECK(shutdownBufferPool(bm));
+  free(bm);
+  free(h);
+  return elapsed / numPages;
+}
+
+// time of one forceFlushPool call that writes every frame of the pool
+double
+timeFlush (int numFrames, const BM_PoolOptions *options)
+{
+  BM_BufferPool *bm = MAKE_POOL();
+  BM_PageHandle *h = MAKE_PAGE_HANDLE();
+  double elapsed;
+  int i;
+
+  createBenchFile(numFrames);
+  CHECK(initBufferPoolWithOptions(bm, BENCH_FILE, numFrames, RS_FIFO, NULL, options));
+  for (i = 0; i < numFrames; i++)
+    {
+      CHECK(pinPage(bm, h, i));
+      h->data[0] = (char) i;
+      CHECK(markDirty(bm, h));
+      CHECK(unpinPage(bm, h));
+    }
+
+  elapsed = nowNs();
+  CHECK(forceFlushPool(bm));
+  elapsed = nowNs() - elapsed;
+
+  CHECK(shutdownBufferPool(bm));
+  free(bm);
+  free(h);
+  return elapsed;
+}
+
+// average time of a random pin/unpin pair on a pool whose frames are all filled
+double
+timeHits (int numFrames, const BM_PoolOptions *options)
+{
+  BM_BufferPool *bm = MAKE_POOL();
+  BM_PageHandle *h = MAKE_PAGE_HANDLE();
+  PageNumber *pages = malloc(sizeof(PageNumber) * BENCH_OPS);
+  unsigned int seed = 42;
+  double start, elapsed;
+  int i;
+
+  createBenchFile(numFrames);
+  CHECK(initBufferPoolWithOptions(bm, BENCH_FILE, numFrames, RS_LRU, NULL, options));
+
+  // fill every frame once so that all timed pins are hits
+  for (i = 0; i < numFrames; i++)
+    {
+      CHECK(pinPage(bm, h, i));
+      CHECK(unpinPage(bm, h));
+    }
+
+  for (i = 0; i < BENCH_OPS; i++)
+    pages[i] = nextRandom(&seed) % numFrames;
+
+  start = nowNs();
+  for (i = 0; i < BENCH_OPS; i++)
+    {
+      pinPage(bm, h, pages[i]);
+      unpinPage(bm, h);
+    }
+  elapsed = nowNs() - start;
+
+  CHECK(shutdownBufferPool(bm));
+  free(pages);
+  free(bm);
+  free(h);
+  return elapsed / BENCH_OPS;
+}
+
+// average time of a pin/unpin pair on an LRU pool whose frames are all filled, for
+// pages that are not in the pool, so every pin replaces the least recently used page
+double
+timeMissesLRU (int numFrames)
+{
+  BM_BufferPool *bm = MAKE_POOL();
+  BM_PageHandle *h = MAKE_PAGE_HANDLE();
+  double start, elapsed;
+  int i;
+
+  createBenchFile(numFrames + BENCH_MISSES);
+  CHECK(initBufferPool(bm, BENCH_FILE, numFrames, RS_LRU, NULL));
+  for (i = 0; i < numFrames; i++)
+    {
+      CHECK(pinPage(bm, h, i));
+      CHECK(unpinPage(bm, h));
+    }
+
+  start = nowNs();
+  for (i = numFrames; i < numFrames + BENCH_MISSES; i++)
+    {
+      pinPage(bm, h, i);
+      unpinPage(bm, h);
+    }
+  elapsed = nowNs() - start;
+
+  CHECK(shutdownBufferPool(bm));
+  free(bm);
+  free(h);
+  return elapsed / BENCH_MISSES;
+}
+
+double
+nowNs (void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// xorshift32, good enough to spread requests over the pool
+unsigned int
+nextRandom (unsigned int *state)
+{
+  unsigned int x = *state;
+
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return *state = x;
+}
+
+// page file with numPages zeroed pages, kept sparse so large pools set up quickly
+void
+createBenchFile (int numPages)
+{
+  CHECK(createPageFile(BENCH_FILE));
+  if (truncate(BENCH_FILE, (off_t) numPages * PAGE_SIZE) != 0)
+    {
+      printf("could not size %s\n", BENCH_FILE);
+      exit(1);
+    }
+}
+
+// page file with numPages pages that are all written to disk. Reading a hole of a sparse
+// file with O_DIRECT does not go to the device, this one makes each read wait for it.
+void
+writeBenchFile (int numPages)
+{
+  char page[PAGE_SIZE];
+  FILE *file = fopen(BENCH_FILE, "w");
+  int i;
+
+  memset(page, 1, PAGE_SIZE);
+  for (i = 0; file != NULL && i < numPages; i++)
+    if (fwrite(page, PAGE_SIZE, 1, file) != 1)
+      break;
+  if (file == NULL || i < numPages || fflush(file) != 0 || fsync(fileno(file)) != 0)
+    {
+      printf("could not write %s\n", BENCH_FILE);
+      exit(1);
+    }
+  fclose(file);
+}
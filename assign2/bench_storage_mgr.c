@@ -0,0 +1,231 @@
+#include "storage_mgr.h"
+#include "dberror.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// page file used by the benchmark, removed again at the end
+#define BENCH_FILE "benchstorage.bin"
+
+// number of timed page reads per measurement
+#define BENCH_OPS 200000
+
+// pages per readBlocks call in the sequential scan
+#define BENCH_RUN 32
+
+// pages added to an empty file when timing file growth
+#define BENCH_GROW_PAGES 65536
+
+// ways of growing a file, timed by timeGrowth
+#define GROW_PAGE_WRITES 0
+#define GROW_ENSURE_CAPACITY 1
+#define GROW_RESERVE_PAGES 2
+
+// helpers
+static double timeStdioReads (const int *pages);
+static double timePreadReads (const int *pages);
+static double timeSequentialScan (int numPages, int runLength);
+static double timeGrowth (int how);
+static double nowNs (void);
+static unsigned int nextRandom (unsigned int *state);
+static void createBenchFile (int numPages);
+
+// usage: bench_storage_mgr [numPages]
+int
+main (int argc, char **argv)
+{
+  int numPages = (argc > 1) ? atoi(argv[1]) : 16384;
+  int *pages = malloc(sizeof(int) * BENCH_OPS);
+  unsigned int seed = 42;
+  double stdioNs, preadNs, singleNs, runNs, growNs[3];
+  char label[64];
+  int i;
+
+  initStorageManager();
+  createBenchFile(numPages);
+  for (i = 0; i < BENCH_OPS; i++)
+    pages[i] = nextRandom(&seed) % numPages;
+
+  // both runs read the file from the page cache, so this compares the per-read overhead
+  stdioNs = timeStdioReads(pages);
+  preadNs = timePreadReads(pages);
+
+  printf("random %i byte reads over %i pages\n", PAGE_SIZE, numPages);
+  printf("%-28s %12s %12s\n", "backend", "ns/read", "IOPS");
+  printf("%-28s %12.1f %12.0f\n", "fopen+fread per read", stdioNs, 1e9 / stdioNs);
+  printf("%-28s %12.1f %12.0f\n", "readBlock (pread)", preadNs, 1e9 / preadNs);
+
+  // a full scan in file order, one page per call against runs of BENCH_RUN pages
+  singleNs = timeSequentialScan(numPages, 1);
+  runNs = timeSequentialScan(numPages, BENCH_RUN);
+
+  printf("\nsequential scan over %i pages\n", numPages);
+  printf("%-28s %12s %12s\n", "backend", "ns/page", "pages/s");
+  printf("%-28s %12.1f %12.0f\n", "readBlock (pread)", singleNs, 1e9 / singleNs);
+  snprintf(label, sizeof(label), "readBlocks (%i page preadv)", BENCH_RUN);
+  printf("%-28s %12.1f %12.0f\n", label, runNs, 1e9 / runNs);
+
+  for (i = 0; i < 3; i++)
+    growNs[i] = timeGrowth(i);
+
+  printf("\ngrowing an empty file by %i pages\n", BENCH_GROW_PAGES);
+  printf("%-28s %12s\n", "method", "ms");
+  printf("%-28s %12.2f\n", "zeroed page writes", growNs[GROW_PAGE_WRITES] / 1e6);
+  printf("%-28s %12.2f\n", "ensureCapacity (ftruncate)", growNs[GROW_ENSURE_CAPACITY] / 1e6);
+  printf("%-28s %12.2f\n", "reservePages (fallocate)", growNs[GROW_RESERVE_PAGES] / 1e6);
+
+  destroyPageFile(BENCH_FILE);
+  free(pages);
+  return 0;
+}
+
+// the former backend: open a stream, seek and read one page, close the stream
+double
+timeStdioReads (const int *pages)
+{
+  char *page = malloc(PAGE_SIZE);
+  double start;
+  int i;
+
+  start = nowNs();
+  for (i = 0; i < BENCH_OPS; i++)
+    {
+      FILE *file = fopen(BENCH_FILE, "r");
+
+      fseek(file, (long) pages[i] * PAGE_SIZE, SEEK_SET);
+      if (fread(page, sizeof(char), PAGE_SIZE, file) < PAGE_SIZE)
+        {
+          printf("short read of page %i\n", pages[i]);
+          exit(1);
+        }
+      fclose(file);
+    }
+  free(page);
+  return (nowNs() - start) / BENCH_OPS;
+}
+
+// positioned reads through the handle opened once by openPageFile
+double
+timePreadReads (const int *pages)
+{
+  SM_FileHandle fh;
+  char *page = malloc(PAGE_SIZE);
+  double start;
+  int i;
+
+  CHECK(openPageFile(BENCH_FILE, &fh));
+  start = nowNs();
+  for (i = 0; i < BENCH_OPS; i++)
+    CHECK(readBlock(pages[i], &fh, page));
+  start = nowNs() - start;
+  CHECK(closePageFile(&fh));
+  free(page);
+  return start / BENCH_OPS;
+}
+
+// reads every page of the file in order, runLength pages per call
+double
+timeSequentialScan (int numPages, int runLength)
+{
+  SM_FileHandle fh;
+  SM_PageHandle pages[BENCH_RUN];
+  double start;
+  int i, n;
+
+  for (i = 0; i < runLength; i++)
+    pages[i] = malloc(PAGE_SIZE);
+  CHECK(openPageFile(BENCH_FILE, &fh));
+  start = nowNs();
+  for (i = 0; i < numPages; i += n)
+    {
+      n = (numPages - i < runLength) ? numPages - i : runLength;
+      if (runLength == 1)
+        {
+          CHECK(readBlock(i, &fh, pages[0]));
+        }
+      else
+        {
+          CHECK(readBlocks(i, n, &fh, pages));
+        }
+    }
+  start = nowNs() - start;
+  CHECK(closePageFile(&fh));
+  for (i = 0; i < runLength; i++)
+    free(pages[i]);
+  return start / numPages;
+}
+
+// grows a fresh page file to BENCH_GROW_PAGES pages. GROW_PAGE_WRITES is the former
+// ensureCapacity, which appended one zeroed page per write.
+double
+timeGrowth (int how)
+{
+  SM_FileHandle fh;
+  char *page = calloc(PAGE_SIZE, 1);
+  double start;
+  int i;
+
+  CHECK(createPageFile(BENCH_FILE));
+  CHECK(openPageFile(BENCH_FILE, &fh));
+  start = nowNs();
+  if (how == GROW_PAGE_WRITES)
+    {
+      for (i = fh.totalNumPages; i < BENCH_GROW_PAGES; i++)
+        CHECK(writeBlock(i, &fh, page));
+    }
+  else if (how == GROW_ENSURE_CAPACITY)
+    {
+      CHECK(ensureCapacity(BENCH_GROW_PAGES, &fh));
+    }
+  else
+    {
+      CHECK(reservePages(BENCH_GROW_PAGES, &fh));
+    }
+  start = nowNs() - start;
+  CHECK(closePageFile(&fh));
+  CHECK(destroyPageFile(BENCH_FILE));
+  free(page);
+  return start;
+}
+
+double
+nowNs (void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// xorshift32, good enough to spread reads over the file
+unsigned int
+nextRandom (unsigned int *state)
+{
+  unsigned int x = *state;
+
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return *state = x;
+}
+
+// page file with numPages pages of data, written out so the reads hit real file blocks
+void
+createBenchFile (int numPages)
+{
+  SM_FileHandle fh;
+  char *page = malloc(PAGE_SIZE);
+  int i;
+
+  CHECK(createPageFile(BENCH_FILE));
+  CHECK(openPageFile(BENCH_FILE, &fh));
+  for (i = 0; i < numPages; i++)
+    {
+      memset(page, 'a' + i % 26, PAGE_SIZE);
+      CHECK(writeBlock(i, &fh, page));
+    }
+  CHECK(closePageFile(&fh));
+  free(page);
+}
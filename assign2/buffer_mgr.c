@@ -1,222 +1,2336 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
 #include "buffer_mgr.h"
 #include "storage_mgr.h"
 #include <math.h>
 
+//Page table partitions used by a concurrent pool when the caller does not choose
+#define DEFAULT_PARTITIONS 16
+
+//Alignment of the frame arena, every frame starts on a page boundary
+#define FRAME_ALIGNMENT 4096
+
+//Requests the I/O engine keeps in flight at once
+#define IO_QUEUE_DEPTH 128
+
+//Size of the huge pages asked for with BM_PoolOptions.hugePages
+#define HUGE_PAGE_SIZE (2UL * 1024 * 1024)
+
+//Address space reserved for the page file mapping of an mmap pool, so the mapping can
+//grow with the file without moving the pages clients hold pointers to
+#define MMAP_RESERVE ((size_t)1 << 36)
+
+//Bounds of BM_PoolOptions.scanRingSize, the ring never takes more than an eighth of the pool
+#define MIN_SCAN_RING (256 * 1024)
+#define MAX_SCAN_RING (16 * 1024 * 1024)
+
+//Pages read ahead of a sequential stream: the first window, and the most it grows to
+#define READAHEAD_MIN 4
+#define READAHEAD_MAX 64
+
+//Stride and correlation prefetcher: repeats of a stride before it is trusted and pages
+//loaded along it, successors kept per page and the pages sharing a set of the successor
+//table, the times a successor must have followed before it is loaded, and the pins after
+//which one wasted speculative read is forgiven
+#define STRIDE_CONFIDENCE 2
+#define STRIDE_DEGREE 16
+#define MARKOV_WAYS 2
+#define MARKOV_ASSOC 4
+#define MARKOV_CONFIDENCE 2
+#define MARKOV_MAX_COUNT 3
+#define MAX_MARKOV_ENTRIES (1 << 16)
+#define PREFETCH_REFILL 16
+#define DEFAULT_PREFETCH_BUDGET 64
+
+//Background writer: milliseconds between rounds, pages written per round and percent of
+//dirty frames that wake it early by default. A round looks at the next quarter of the
+//pool's victims, or more if it may write more pages than that.
+#define DEFAULT_BGWRITER_DELAY 200
+#define DEFAULT_BGWRITER_MAX_PAGES 100
+#define DEFAULT_DIRTY_WATERMARK 10
+#define BGWRITER_LOOKAHEAD 4
+
+//How the page in a frame came in, if nobody pinned it since
+#define PREFETCH_NONE 0
+#define PREFETCH_READAHEAD 1
+#define PREFETCH_SPECULATIVE 2
+#define PREFETCH_EXPLICIT 3
+
 typedef struct Page {
     SM_PageHandle data;
     PageNumber pageNum;
-    int dirtyBit;
-    int fixCount;
-    int hitNum;
-    int refNum;
+    atomic_int dirtyBit;     //Changed through setDirty, which counts the dirty frames
+    atomic_int fixCount;
+    atomic_int ioInProgress; //Set while the page is being read into the frame
+    atomic_int writeInProgress; //Set while a flush writes the page out, the latch is not held meanwhile
+    int ioError;             //The last read into this frame failed
+    atomic_uint version;     //Odd while the page is loaded or written exclusively, see pinPageOptimistic
+    unsigned char prefetched; //PREFETCH_NONE once pinned, changed under the page's partition lock
 } PageFrame;
 
-//Variables to work on the buffer functions 
-int buffer_size = 0;
-int last_index_bp = 0; //Last position in buffer pool used for FIFO Stratergy
-int track_write_count = 0;
-int hit = 0;  //Count the page hits - when page is already present in the buffer
-int clock_pointer = 0;
-int lfu_pointer = 0;
+//Replacement state of RS_FIFO
+typedef struct FIFOState {
+    int numFrames;
+    int loadCount;     //Pages loaded so far, the search for a victim starts at loadCount % numFrames
+} FIFOState;
+
+//Replacement state of RS_LRU: a doubly linked recency list of the unpinned frames
+typedef struct LRUState {
+    int head;          //Most recently unpinned frame, -1 if the list is empty
+    int tail;
+    int *prev;         //Neighbours of each frame in the list, -1 at its ends
+    int *next;
+    bool *linked;      //The frame is in the list
+} LRUState;
+
+//Replacement state of RS_CLOCK
+typedef struct ClockState {
+    int numFrames;
+    int hand;          //Next frame the search looks at
+    bool *used;        //Reference bit of each frame, cleared as the hand passes
+} ClockState;
+
+//Pages that misses went to right after one page, for the prefetcher
+typedef struct Successors {
+    PageNumber page;
+    PageNumber next[MARKOV_WAYS];      //Most frequent first
+    unsigned char count[MARKOV_WAYS];  //Times it followed, up to MARKOV_MAX_COUNT
+} Successors;
+
+//Stride and correlation prefetcher of a pool, guarded by policyLock
+typedef struct Prefetcher {
+    PageNumber last;     //Page of the previous miss or prefetch hit
+    int stride;          //Distance from the one before it
+    int strideRepeats;   //Steps in a row that kept that distance
+    PageNumber strideEnd; //Last page loaded along the stride
+    int degree;          //Pages loaded ahead along a stride, STRIDE_DEGREE or a quarter of the pool
+    Successors *table;   //Sets of MARKOV_ASSOC entries hashed by page number, most recently used first
+    int shift;           //32 - log2 of the number of sets
+    int budget;          //BM_PoolOptions.prefetchBudget
+    int credit;          //Speculative reads that may still start, one is refunded per hit
+    int observed;        //Pages seen, a credit comes back every PREFETCH_REFILL of them
+} Prefetcher;
+
+//Page table: open addressing hash map from page number to frame index.
+//Linear probing, deletions use backward shifting so no tombstones are needed.
+typedef struct PageTable {
+    PageNumber *keys;  //NO_PAGE marks an empty slot
+    int *frames;
+    int capacity;      //Always a power of two
+    int shift;         //32 - log2(capacity), used by the hash function
+    int count;
+} PageTable;
+
+//LRU-K history of the page in a frame, or of an evicted page that is still remembered.
+//refs holds the times of the page's last K uncorrelated references, newest first, 0 for none.
+typedef struct LRUKHistory {
+    PageNumber pageNum;
+    long last;   //Time of the last reference, correlated or not
+    long *refs;
+} LRUKHistory;
+
+//Replacement state of RS_LRU_K. Time counts the references to pages of the pool.
+typedef struct LRUKState {
+    int k;
+    long correlatedPeriod;
+    long now;
+    LRUKHistory *frames;     //History of the page in each frame
+    int *heap;               //Frames holding a page, min-heap on (refs[k-1], last): the victim is on top
+    int *heapPos;            //Index of each frame in heap, -1 until it got a page
+    int heapSize;
+    int *skipped;            //Pinned frames taken off the heap while looking for a victim
+    LRUKHistory *retained;   //Histories of the last numRetained evicted pages, used as a ring
+    int numRetained;
+    int retainedNext;
+    PageTable retainedIndex; //Page number to its slot in retained
+    long *refsBlock;         //Memory of all refs arrays
+} LRUKState;
+
+//One frequency bucket of RS_LFU: the frames whose page has been referenced freq times
+typedef struct LFUBucket {
+    int freq;
+    int prev;   //Bucket with the next lower frequency, -1 for the lowest
+    int next;   //Bucket with the next higher frequency, -1 for the highest
+    int head;   //Unpinned frames of the bucket, most recently unpinned first
+    int tail;
+    int pinnedHead; //Pinned frames of the bucket, in no particular order
+} LFUBucket;
+
+//Replacement state of RS_LFU. Buckets form a list sorted by frequency and only exist
+//while they hold frames, so there are never more than one per frame plus a spare.
+typedef struct LFUState {
+    LFUBucket *buckets;
+    int lowest;       //Bucket with the lowest frequency, -1 while no frame holds a page
+    int freeBuckets;  //Unused buckets, chained through next
+    int *bucketOf;    //Bucket of each frame, -1 if it is in none
+    bool *pinned;     //The frame is on the pinned list of its bucket
+    int *prev;        //Neighbours of each frame inside its list, -1 at the ends
+    int *next;
+    long refs;        //References since the counts were last halved
+    long agingPeriod;
+} LFUState;
+
+//Frames and ghosts of RS_ARC and RS_2Q, linked into the lists of the strategy. Nodes
+//0 .. numFrames-1 are the frames, the nodes after them ghosts: page numbers of evicted
+//pages that are still remembered. Every list is most recent first.
+#define NO_LIST 0
+#define MAX_LISTS 6
+
+typedef struct GhostLists {
+    int head[MAX_LISTS];
+    int tail[MAX_LISTS];
+    int size[MAX_LISTS];
+    int *prev;              //Neighbours of each node in its list, -1 at the ends
+    int *next;
+    unsigned char *list;    //List each node is in, NO_LIST for none
+    PageNumber *pages;      //Page of each node, NO_PAGE if it has none
+    int freeGhosts;         //Unused ghost nodes, chained through next
+    PageTable ghostIndex;   //Page number of a ghost to its node
+} GhostLists;
+
+//Lists of RS_ARC. Frames holding a page are in T1 or T2, the page numbers of pages
+//evicted from them are remembered in the ghost lists B1 and B2.
+typedef enum ARCList {
+    ARC_T1 = 1,    //Pages referenced once since they were loaded
+    ARC_T2 = 2,    //Pages referenced again while they were in the pool or a ghost list
+    ARC_B1 = 3,    //Ghosts of pages evicted from T1
+    ARC_B2 = 4,    //Ghosts of pages evicted from T2
+    ARC_FREE = 5   //Frames that lost their page because it could not be read
+} ARCList;
+
+//Replacement state of RS_ARC. There are 2c ghosts, as many as B1 and B2 can ever hold.
+typedef struct ARCState {
+    int c;                  //Frames of the pool
+    int p;                  //Target size of T1, adapted on every ghost hit
+    GhostLists lists;
+} ARCState;
+
+//Lists of RS_2Q
+typedef enum TwoQList {
+    TWOQ_A1IN = 1,   //Pages seen once, in FIFO order
+    TWOQ_AM = 2,     //Pages pinned again while A1out remembered them, in LRU order
+    TWOQ_A1OUT = 3,  //Ghosts of pages evicted from A1in
+    TWOQ_FREE = 4    //Frames that lost their page because it could not be read
+} TwoQList;
+
+//Replacement state of RS_2Q. There is one ghost more than A1out holds, so a ghost can be
+//added before the oldest one is dropped.
+typedef struct TwoQState {
+    int inSize;      //A1in gives up its oldest page while it holds more frames than this
+    int outSize;     //Ghosts A1out remembers
+    GhostLists lists;
+} TwoQState;
+
+//Rows of the TinyLFU sketch, each counts a page under a different hash
+#define SKETCH_DEPTH 4
+
+//Saturation value of the sketch counters, they fit in 4 bits
+#define SKETCH_MAX 15
+
+//TinyLFU admission filter: a count-min sketch of recent page references. The first
+//reference of a page only sets its bits in the doorkeeper bloom filter, so pages seen
+//once never reach the sketch. After sampleSize references all counters are halved and
+//the doorkeeper is cleared, so the counts follow the recent workload.
+typedef struct AdmissionFilter {
+    unsigned char *counters;  //SKETCH_DEPTH rows of width counters
+    unsigned long *doorkeeper;
+    int widthMask;            //width - 1, width is a power of two
+    int doorMask;             //Bits of the doorkeeper - 1, also a power of two
+    long additions;           //References since the last reset
+    long sampleSize;
+} AdmissionFilter;
+
+//One stripe of the page table. Pages are spread over the stripes by page number,
+//so pins of different pages rarely wait for the same lock.
+typedef struct PagePartition {
+    pthread_mutex_t lock;
+    PageTable table;
+} PagePartition;
+
+//Latches of one frame, only allocated for concurrent pools. The mutex protects
+//the frame metadata, the rwlock the page content for shared and exclusive pins.
+typedef struct FrameLatch {
+    pthread_mutex_t mutex;
+    pthread_cond_t ioDone;
+    pthread_rwlock_t content;
+} FrameLatch;
+
+//A dirty page picked up by forceFlushPool, sorted by page number to find runs
+typedef struct FlushEntry {
+    PageNumber pageNum;
+    int frame;
+} FlushEntry;
+
+//Background writer of a pool. lock guards stop and is held for a whole round, so a
+//forceFlushPool never runs next to one.
+typedef struct BackgroundWriter {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;     //Signalled at shutdown and when the dirty frames reach the watermark
+    bool stop;
+    BM_BufferPool pool;      //Copy of the caller's handle, which may move while the pool is open
+    int delay;               //BM_PoolOptions.bgWriterDelay
+    int maxPages;
+    int watermark;           //Dirty frames that wake the writer
+    int lookahead;           //Victims looked at per round
+    int hand;                //Next frame of the sweep used when the policy cannot tell its victims
+    int *candidates;         //lookahead frames
+    FlushEntry *dirty;       //maxPages pages picked in a round
+} BackgroundWriter;
+
+//Bookkeeping stored in BM_BufferPool.mgmtData, one per buffer pool
+//Lock order: page table partition, then policyLock, then frame latch.
+typedef struct BM_PoolMgmt {
+    PageFrame *frames;
+    char *arena;               //numPages * PAGE_SIZE bytes, frame i uses the i-th page of it
+    size_t arenaSize;          //Mapped length if the arena came from mmap, 0 if from posix_memalign
+    PagePartition *partitions;
+    int numPartitions;         //Always a power of two
+    FrameLatch *latches;       //NULL unless the pool is concurrent
+    bool concurrent;
+    SM_FileHandle fh;          //Page file, opened by initBufferPool and kept open until shutdown
+    IO_Engine *io;             //Moves pages of fh, batches flushes
+    IO_Request *ioRequests;    //One per frame, used by whoever holds the frame for a read or write
+    pthread_mutex_t policyLock; //Protects the replacement state below
+
+    char *map;                 //Page file mapping of an mmap pool, NULL for frame based pools
+    size_t mapReserved;        //Length of the address range reserved for the mapping
+    atomic_int mappedPages;    //Pages of the file mapped so far, grown under mapLock
+    pthread_mutex_t mapLock;
+
+    int usedFrames;    //Frames are filled in order, so frames[usedFrames] is the next empty one
+    const BM_ReplacementPolicy *policy; //Replacement strategy, called under policyLock
+    void *policyState; //What policy->init returned for this pool, its params without an init
+    AdmissionFilter *admission; //Only allocated with BM_PoolOptions.admissionFilter
+    int bypass;        //Frame after the last one, holding a page that was not admitted, -1 without a filter
+    int *ring;         //Frames sequential pins recycle, -1 for a slot not filled yet
+    PageNumber *ringPages; //Page the ring read into each of them
+    int ringSize;
+    int ringNext;      //Slot the next sequential miss uses
+
+    bool readAhead;    //BM_PoolOptions.readAhead, the stream state below is guarded by policyLock
+    PageNumber streamNext; //Page a sequential stream pins next
+    int raWindow;      //Pages kept read ahead of the stream, 0 while there is none
+    PageNumber raEnd;  //One past the last page read ahead
+    Prefetcher *prefetcher; //Only allocated with BM_PoolOptions.prefetcher
+    BackgroundWriter *writer; //Only allocated with BM_PoolOptions.backgroundWriter
+
+    atomic_int readCount;  //Number of pages read from disk
+    atomic_int writeCount; //Number of pages written to disk
+    atomic_int prefetchHits;   //Pins that found a page read ahead for them
+    atomic_int prefetchWasted; //Pages read ahead and replaced before anybody pinned them
+    atomic_int dirtyFrames;    //Frames with the dirty bit set
+    atomic_int syncWrites;     //Misses that wrote their dirty victim back themselves
+} BM_PoolMgmt;
+
+// Function prototypes
+extern RC initBufferPool(BM_BufferPool *const bm, const char *const pageFileName,const int numPages, ReplacementStrategy strategy, void *stratData);
+
+extern RC shutdownBufferPool(BM_BufferPool *const bm);
+extern RC forceFlushPool(BM_BufferPool *const bm);
+extern RC markDirty(BM_BufferPool *const bm, BM_PageHandle *const page);
+extern RC unpinPage(BM_BufferPool *const bm, BM_PageHandle *const page);
+extern RC forcePage(BM_BufferPool *const bm, BM_PageHandle *const page);
+extern RC pinPage(BM_BufferPool *const bm, BM_PageHandle *const page,
+                   const PageNumber pageNum);
+extern RC prefetchPages(BM_BufferPool *const bm, const PageNumber *pages, int n);
+
+extern PageNumber *getFrameContents(BM_BufferPool *const bm);
+extern bool *getDirtyFlags(BM_BufferPool *const bm);
+extern int *getFixCounts(BM_BufferPool *const bm);
+extern int getNumReadIO(BM_BufferPool *const bm);
+extern int getNumWriteIO(BM_BufferPool *const bm);
+extern int getNumPrefetchHits(BM_BufferPool *const bm);
+extern int getNumPrefetchWasted(BM_BufferPool *const bm);
+extern int getNumSyncWrites(BM_BufferPool *const bm);
+
+//Page table helpers
+
+//Fibonacci hashing spreads consecutive page numbers over the whole table
+static inline int pageTableSlot(PageTable *table, PageNumber pageNum) {
+    return (int)(((unsigned int)pageNum * 2654435769u) >> table->shift);
+}
+
+static RC pageTableInit(PageTable *table, int numPages) {
+    int capacity = 2, bits = 1, i;
+
+    //Keep the load factor at or below 50% so probe sequences stay short
+    while (capacity < 2 * numPages) {
+        capacity <<= 1;
+        bits++;
+    }
+    table->keys = malloc(sizeof(PageNumber) * capacity);
+    table->frames = malloc(sizeof(int) * capacity);
+    if (table->keys == NULL || table->frames == NULL) {
+        free(table->keys);
+        free(table->frames);
+        return RC_BP_INIT_ERROR;
+    }
+    for (i = 0; i < capacity; i++)
+        table->keys[i] = NO_PAGE;
+    table->capacity = capacity;
+    table->shift = 32 - bits;
+    table->count = 0;
+    return RC_OK;
+}
+
+static void pageTableFree(PageTable *table) {
+    free(table->keys);
+    free(table->frames);
+    table->keys = NULL;
+    table->frames = NULL;
+}
+
+//Returns the frame index holding pageNum, or -1 if the page is not in the pool
+static int pageTableLookup(PageTable *table, PageNumber pageNum) {
+    int mask = table->capacity - 1;
+    int slot = pageTableSlot(table, pageNum);
+
+    while (table->keys[slot] != NO_PAGE) {
+        if (table->keys[slot] == pageNum)
+            return table->frames[slot];
+        slot = (slot + 1) & mask;
+    }
+    return -1;
+}
+
+static void pageTableInsert(PageTable *table, PageNumber pageNum, int frameIndex);
+
+//Doubles the table. A partition only sees the pages that hash to it, so its
+//share of the pool can exceed the size it was created with.
+static void pageTableGrow(PageTable *table) {
+    PageTable bigger;
+    int i;
+
+    if (pageTableInit(&bigger, table->capacity) != RC_OK)
+        return; //Keep probing the full table, lookups stay correct
+    for (i = 0; i < table->capacity; i++)
+        if (table->keys[i] != NO_PAGE)
+            pageTableInsert(&bigger, table->keys[i], table->frames[i]);
+    pageTableFree(table);
+    *table = bigger;
+}
+
+static void pageTableInsert(PageTable *table, PageNumber pageNum, int frameIndex) {
+    int mask, slot;
+
+    if (2 * (table->count + 1) > table->capacity)
+        pageTableGrow(table);
+    mask = table->capacity - 1;
+    slot = pageTableSlot(table, pageNum);
+    while (table->keys[slot] != NO_PAGE && table->keys[slot] != pageNum)
+        slot = (slot + 1) & mask;
+    if (table->keys[slot] == NO_PAGE)
+        table->count++;
+    table->keys[slot] = pageNum;
+    table->frames[slot] = frameIndex;
+}
+
+static void pageTableRemove(PageTable *table, PageNumber pageNum) {
+    int mask = table->capacity - 1;
+    int slot = pageTableSlot(table, pageNum);
+    int next, home;
+
+    while (table->keys[slot] != pageNum) {
+        if (table->keys[slot] == NO_PAGE)
+            return;
+        slot = (slot + 1) & mask;
+    }
+
+    //Shift following entries back so lookups never stop at the hole early
+    next = (slot + 1) & mask;
+    while (table->keys[next] != NO_PAGE) {
+        home = pageTableSlot(table, table->keys[next]);
+        //Move the entry only if the hole lies on its probe path (home .. next)
+        if (((next - home) & mask) >= ((next - slot) & mask)) {
+            table->keys[slot] = table->keys[next];
+            table->frames[slot] = table->frames[next];
+            slot = next;
+        }
+        next = (next + 1) & mask;
+    }
+    table->keys[slot] = NO_PAGE;
+    table->count--;
+}
+
+//Latch helpers, all of them do nothing for a pool that is not concurrent
+
+static inline PagePartition *partitionOf(BM_PoolMgmt *mgmt, PageNumber pageNum) {
+    return &mgmt->partitions[pageNum & (mgmt->numPartitions - 1)];
+}
+
+static inline void lockPartition(BM_PoolMgmt *mgmt, PagePartition *part) {
+    if (mgmt->concurrent)
+        pthread_mutex_lock(&part->lock);
+}
+
+static inline bool tryLockPartition(BM_PoolMgmt *mgmt, PagePartition *part) {
+    return !mgmt->concurrent || pthread_mutex_trylock(&part->lock) == 0;
+}
+
+static inline void unlockPartition(BM_PoolMgmt *mgmt, PagePartition *part) {
+    if (mgmt->concurrent)
+        pthread_mutex_unlock(&part->lock);
+}
+
+static inline void lockPolicy(BM_PoolMgmt *mgmt) {
+    if (mgmt->concurrent)
+        pthread_mutex_lock(&mgmt->policyLock);
+}
+
+static inline void unlockPolicy(BM_PoolMgmt *mgmt) {
+    if (mgmt->concurrent)
+        pthread_mutex_unlock(&mgmt->policyLock);
+}
+
+static inline void lockFrame(BM_PoolMgmt *mgmt, int frameIndex) {
+    if (mgmt->concurrent)
+        pthread_mutex_lock(&mgmt->latches[frameIndex].mutex);
+}
+
+static inline void unlockFrame(BM_PoolMgmt *mgmt, int frameIndex) {
+    if (mgmt->concurrent)
+        pthread_mutex_unlock(&mgmt->latches[frameIndex].mutex);
+}
+
+//Sets or clears the dirty bit of frame i and keeps count of the dirty frames. Reaching
+//the watermark wakes the background writer before its delay has run out.
+static void setDirty(BM_PoolMgmt *mgmt, int frameIndex, int dirty) {
+    if (atomic_exchange(&mgmt->frames[frameIndex].dirtyBit, dirty) == dirty)
+        return;
+    if (!dirty)
+        mgmt->dirtyFrames--;
+    else if (++mgmt->dirtyFrames == (mgmt->writer != NULL ? mgmt->writer->watermark : 0))
+        pthread_cond_signal(&mgmt->writer->wake);
+}
+
+//Pins frame i if it still holds pageNum, so it cannot be evicted while the caller uses it
+static bool pinFrameIfHolds(BM_PoolMgmt *mgmt, int frameIndex, PageNumber pageNum) {
+    PagePartition *part = partitionOf(mgmt, pageNum);
+    bool pinned = false;
+
+    lockPartition(mgmt, part);
+    if (pageTableLookup(&part->table, pageNum) == frameIndex) {
+        mgmt->frames[frameIndex].fixCount++;
+        pinned = true;
+    }
+    unlockPartition(mgmt, part);
+    return pinned;
+}
+
+//Page I/O helpers
+
+static int compareFlushEntries(const void *a, const void *b) {
+    PageNumber x = ((const FlushEntry *)a)->pageNum, y = ((const FlushEntry *)b)->pageNum;
+
+    return (x > y) - (x < y);
+}
+
+//Publishes a frame that was being loaded to clients waiting in waitForFrame
+static void publishFrame(BM_PoolMgmt *mgmt, int frameIndex, RC rc) {
+    PageFrame *frame = &mgmt->frames[frameIndex];
+
+    lockFrame(mgmt, frameIndex);
+    frame->ioError = (rc != RC_OK);
+    frame->ioInProgress = 0;
+    frame->version++;
+    if (mgmt->concurrent)
+        pthread_cond_broadcast(&mgmt->latches[frameIndex].ioDone);
+    unlockFrame(mgmt, frameIndex);
+}
+
+//Completion of a read into a frame
+static void frameReadDone(IO_Request *req) {
+    BM_PoolMgmt *mgmt = req->userData;
+
+    if (req->rc == RC_OK)
+        mgmt->readCount++;
+    publishFrame(mgmt, req - mgmt->ioRequests, req->rc);
+}
+
+//Maps the pages of the file up to numPages into the reserved range, after the ones
+//mapped already. The caller holds mapLock or is still initializing the pool.
+static RC growMapping(BM_PoolMgmt *mgmt, int numPages) {
+    size_t offset = (size_t)mgmt->mappedPages * PAGE_SIZE;
+    size_t length = (size_t)(numPages - mgmt->mappedPages) * PAGE_SIZE;
+
+    if (numPages <= mgmt->mappedPages)
+        return RC_OK;
+    if (offset + length > mgmt->mapReserved)
+        return RC_READ_NON_EXISTING_PAGE;
+    if (mmap(mgmt->map + offset, length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED,
+             getFileDescriptor(&mgmt->fh), offset) == MAP_FAILED)
+        return RC_READ_FAILED;
+    mgmt->mappedPages = numPages;
+    return RC_OK;
+}
+
+//Reserves the address range of an mmap pool and maps the page file into its start
+static RC mapPageFile(BM_PoolMgmt *mgmt) {
+    size_t fileSize = (size_t)mgmt->fh.totalNumPages * PAGE_SIZE;
+    void *map;
+
+    mgmt->mapReserved = (fileSize > MMAP_RESERVE) ? fileSize : MMAP_RESERVE;
+    map = mmap(NULL, mgmt->mapReserved, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (map == MAP_FAILED)
+        return RC_BP_INIT_ERROR;
+    mgmt->map = map;
+    mgmt->mappedPages = 0;
+    if (growMapping(mgmt, mgmt->fh.totalNumPages) != RC_OK) {
+        munmap(map, mgmt->mapReserved);
+        mgmt->map = NULL;
+        return RC_BP_INIT_ERROR;
+    }
+    pthread_mutex_init(&mgmt->mapLock, NULL);
+    return RC_OK;
+}
+
+//Points frame i of an mmap pool at pageNum in the mapping, growing file and mapping first
+//if the page lies past their end. Nothing is copied. A page the kernel does not hold yet
+//will be faulted in from disk, so it is counted as a read.
+static RC mapFrame(BM_PoolMgmt *mgmt, int frameIndex, PageNumber pageNum) {
+    char *data = mgmt->map + (size_t)pageNum * PAGE_SIZE;
+    unsigned char resident = 1;
+    RC rc = RC_OK;
+
+    if (pageNum >= mgmt->mappedPages) {
+        pthread_mutex_lock(&mgmt->mapLock);
+        rc = ensureCapacity(pageNum + 1, &mgmt->fh);
+        if (rc == RC_OK)
+            rc = growMapping(mgmt, mgmt->fh.totalNumPages);
+        pthread_mutex_unlock(&mgmt->mapLock);
+    }
+    if (rc == RC_OK) {
+        mgmt->frames[frameIndex].data = data;
+        if (mincore(data, PAGE_SIZE, &resident) == 0 && (resident & 1) == 0)
+            mgmt->readCount++;
+    }
+    publishFrame(mgmt, frameIndex, rc);
+    return rc;
+}
+
+//Writes numPages pages that follow each other in an mmap pool's mapping back to disk
+static RC syncPages(char *data, int numPages) {
+    return (msync(data, (size_t)numPages * PAGE_SIZE, MS_SYNC) == 0) ? RC_OK : RC_WRITE_FAILED;
+}
+
+//Starts reading pageNum into frame i, growing the file first if the page lies past its end.
+//The frame must be claimed and marked ioInProgress, frameReadDone runs once the read is over.
+//If the read cannot be started the frame is completed with the error right away.
+static RC startFrameRead(BM_PoolMgmt *mgmt, int frameIndex, PageNumber pageNum) {
+    IO_Request *req = &mgmt->ioRequests[frameIndex];
+    RC rc;
+
+    req->op = IO_READ;
+    req->pageNum = pageNum;
+    req->data = mgmt->frames[frameIndex].data;
+    req->numPages = 1;
+    req->onComplete = frameReadDone;
+    req->userData = mgmt;
+    rc = ensureCapacity(pageNum + 1, &mgmt->fh);
+    //Once started the request belongs to the engine until waitIO returns
+    if (rc == RC_OK)
+        rc = startIO(mgmt->io, req);
+    if (rc != RC_OK) {
+        req->rc = rc;
+        frameReadDone(req);
+    }
+    return rc;
+}
+
+//Writes the page held by frame i back to disk. The caller keeps the frame pinned.
+static RC writeFrame(BM_BufferPool *const bm, int frameIndex) {
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bm->mgmtData;
+    PageFrame *frame = &mgmt->frames[frameIndex];
+    RC rc;
+
+    lockFrame(mgmt, frameIndex);
+    //A flush may be writing the page already, the two writes must not overlap
+    while (frame->writeInProgress)
+        pthread_cond_wait(&mgmt->latches[frameIndex].ioDone, &mgmt->latches[frameIndex].mutex);
+    //Clear the dirty bit before writing so a markDirty racing with the write is not lost
+    setDirty(mgmt, frameIndex, 0);
+    if (mgmt->map != NULL)
+        rc = syncPages(frame->data, 1);
+    else
+        rc = writeBlock(frame->pageNum, &mgmt->fh, frame->data);
+    if (rc == RC_OK)
+        mgmt->writeCount++;
+    else
+        setDirty(mgmt, frameIndex, 1);
+    unlockFrame(mgmt, frameIndex);
+    return rc;
+}
+
+//Blocks until a read into frame i started by another client has finished. Nobody waits
+//for a read started by read-ahead, so the first client pinning the page completes it if
+//pollIO has not yet. Pages nobody pins are completed by pollIO, see pinPageWithHint.
+static RC waitForFrame(BM_PoolMgmt *mgmt, int frameIndex, bool prefetched) {
+    PageFrame *frame = &mgmt->frames[frameIndex];
+    RC rc = RC_OK;
+
+    if (!frame->ioInProgress && !frame->ioError)
+        return RC_OK;
+    if (prefetched)
+        waitIO(mgmt->io, &mgmt->ioRequests[frameIndex]);
+    lockFrame(mgmt, frameIndex);
+    while (frame->ioInProgress)
+        pthread_cond_wait(&mgmt->latches[frameIndex].ioDone, &mgmt->latches[frameIndex].mutex);
+    if (frame->ioError)
+        rc = RC_READ_FAILED;
+    unlockFrame(mgmt, frameIndex);
+    return rc;
+}
+
+/*
+ * Tells a replacement policy whether a client holds the page in a frame, or the page
+ * is still being read ahead. A pinned frame must not be returned by pickVictim.
+ */
+extern bool isFramePinned(BM_BufferPool *const bm, int frameIndex) {
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bm->mgmtData;
+
+    return mgmt->frames[frameIndex].fixCount != 0 || mgmt->frames[frameIndex].ioInProgress;
+}
+
+//Replacement Stratergies
+//Each strategy is a BM_ReplacementPolicy with its own state per pool. pickVictim returns
+//the frame to evict, or -1 if every frame is pinned. It only chooses, pinPage does the
+//write back and the reload, and calls onEvict and onLoad once the frame is taken.
+
+//FIFO - First In First Out
+// Replaces the oldest page in the buffer, following a queue-like structure.
+// The page loaded first is the first removed from the buffer.
+static void *fifoCreate(int numFrames, void *params) {
+    FIFOState *s = calloc(1, sizeof(FIFOState));
+
+    if (s != NULL)
+        s->numFrames = numFrames;
+    return s;
+}
+
+static void fifoLoad(void *state, int frameIndex, PageNumber pageNum) {
+    ((FIFOState *)state)->loadCount++;
+}
+
+static int FIFO(void *state, BM_BufferPool *const bm, PageNumber pageNum) {
+    FIFOState *s = state;
+    int i, from_index_FIFO;
+
+    //Pages are loaded round robin, so the front of the queue follows the load count
+    from_index_FIFO = s->loadCount % s->numFrames;
+
+    for (i = 0; i < s->numFrames; i++) {
+        //Find the suitable page to replace
+        if (!isFramePinned(bm, from_index_FIFO)) //Check if the page is not currently in use
+            return from_index_FIFO;
+        from_index_FIFO = (from_index_FIFO + 1) % s->numFrames; // Move to the next page buffer
+    }
+    return -1;
+}
+
+//The unpinned frames from the front of the queue on
+static int fifoNextVictims(void *state, BM_BufferPool *const bm, int *frames, int max) {
+    FIFOState *s = state;
+    int i, f, n = 0;
+
+    for (i = 0; i < s->numFrames && n < max; i++) {
+        f = (s->loadCount + i) % s->numFrames;
+        if (!isFramePinned(bm, f))
+            frames[n++] = f;
+    }
+    return n;
+}
+
+//LFU - Least Frequently used
+// Replaces the page with the lowest reference count, the least recently unpinned one
+// among pages with the same count. Frames sit in frequency buckets, so a reference moves
+// its frame one bucket up. A pinned frame waits on a list of its own in its bucket and
+// only joins the unpinned frames with its last unpin, like in LRU, so the victim is the
+// tail of the lowest bucket that has unpinned frames. All counts are halved every
+// agingPeriod references, so pages that were hot long ago lose their lead over pages in
+// use now.
+
+//Takes an unused bucket for freq and links it between the buckets prev and next
+static int lfuNewBucket(LFUState *s, int freq, int prev, int next) {
+    int b = s->freeBuckets;
+
+    s->freeBuckets = s->buckets[b].next;
+    s->buckets[b].freq = freq;
+    s->buckets[b].head = s->buckets[b].tail = s->buckets[b].pinnedHead = -1;
+    s->buckets[b].prev = prev;
+    s->buckets[b].next = next;
+    if (prev >= 0)
+        s->buckets[prev].next = b;
+    else
+        s->lowest = b;
+    if (next >= 0)
+        s->buckets[next].prev = b;
+    return b;
+}
+
+static void lfuFreeBucket(LFUState *s, int b) {
+    if (s->buckets[b].prev >= 0)
+        s->buckets[s->buckets[b].prev].next = s->buckets[b].next;
+    else
+        s->lowest = s->buckets[b].next;
+    if (s->buckets[b].next >= 0)
+        s->buckets[s->buckets[b].next].prev = s->buckets[b].prev;
+    s->buckets[b].next = s->freeBuckets;
+    s->freeBuckets = b;
+}
+
+//Takes the frame off the list it is on in bucket b, which stays even if it is empty now
+static void lfuUnlink(LFUState *s, int frameIndex, int b) {
+    if (s->prev[frameIndex] >= 0)
+        s->next[s->prev[frameIndex]] = s->next[frameIndex];
+    else if (s->pinned[frameIndex])
+        s->buckets[b].pinnedHead = s->next[frameIndex];
+    else
+        s->buckets[b].head = s->next[frameIndex];
+    if (s->next[frameIndex] >= 0)
+        s->prev[s->next[frameIndex]] = s->prev[frameIndex];
+    else if (!s->pinned[frameIndex])
+        s->buckets[b].tail = s->prev[frameIndex];
+}
+
+//Takes the frame out of its bucket, the bucket goes away once it is empty
+static void lfuRemove(LFUState *s, int frameIndex) {
+    int b = s->bucketOf[frameIndex];
+
+    if (b < 0)
+        return;
+    lfuUnlink(s, frameIndex, b);
+    s->bucketOf[frameIndex] = -1;
+    if (s->buckets[b].head < 0 && s->buckets[b].pinnedHead < 0)
+        lfuFreeBucket(s, b);
+}
+
+//Puts the frame on the pinned list of bucket b
+static void lfuAddPinned(LFUState *s, int frameIndex, int b) {
+    s->prev[frameIndex] = -1;
+    s->next[frameIndex] = s->buckets[b].pinnedHead;
+    if (s->buckets[b].pinnedHead >= 0)
+        s->prev[s->buckets[b].pinnedHead] = frameIndex;
+    s->buckets[b].pinnedHead = frameIndex;
+    s->bucketOf[frameIndex] = b;
+    s->pinned[frameIndex] = true;
+}
+
+//Puts the frame among the unpinned frames of bucket b
+static void lfuAdd(LFUState *s, int frameIndex, int b, bool atHead) {
+    LFUBucket *bucket = &s->buckets[b];
+
+    s->pinned[frameIndex] = false;
+    if (atHead) {
+        s->prev[frameIndex] = -1;
+        s->next[frameIndex] = bucket->head;
+        if (bucket->head >= 0)
+            s->prev[bucket->head] = frameIndex;
+        else
+            bucket->tail = frameIndex;
+        bucket->head = frameIndex;
+    } else {
+        s->next[frameIndex] = -1;
+        s->prev[frameIndex] = bucket->tail;
+        if (bucket->tail >= 0)
+            s->next[bucket->tail] = frameIndex;
+        else
+            bucket->head = frameIndex;
+        bucket->tail = frameIndex;
+    }
+    s->bucketOf[frameIndex] = b;
+}
+
+//Bucket for one of the lowest counts (0 or 1), created if needed. Only the lowest one or
+//two buckets are looked at, so this is constant time as well.
+static int lfuLowBucket(LFUState *s, int freq) {
+    int b = s->lowest, prev = -1;
+
+    while (b >= 0 && s->buckets[b].freq < freq) {
+        prev = b;
+        b = s->buckets[b].next;
+    }
+    if (b >= 0 && s->buckets[b].freq == freq)
+        return b;
+    return lfuNewBucket(s, freq, prev, b);
+}
+
+//Halves every count. Buckets whose counts meet are merged, the unpinned frames of the
+//lower one going behind those of the higher one, so the eviction order is kept.
+static void lfuAge(LFUState *s) {
+    int b, next, lower, f, last = -1;
+
+    for (b = s->lowest; b >= 0; b = next) {
+        next = s->buckets[b].next;
+        s->buckets[b].freq /= 2;
+        lower = s->buckets[b].prev;
+        if (lower < 0 || s->buckets[lower].freq != s->buckets[b].freq)
+            continue;
+        for (f = s->buckets[lower].head; f >= 0; f = s->next[f])
+            s->bucketOf[f] = b;
+        if (s->buckets[lower].head >= 0) {
+            if (s->buckets[b].tail >= 0)
+                s->next[s->buckets[b].tail] = s->buckets[lower].head;
+            else
+                s->buckets[b].head = s->buckets[lower].head;
+            s->prev[s->buckets[lower].head] = s->buckets[b].tail;
+            s->buckets[b].tail = s->buckets[lower].tail;
+        }
+        for (f = s->buckets[lower].pinnedHead; f >= 0; f = s->next[f]) {
+            s->bucketOf[f] = b;
+            last = f;
+        }
+        if (s->buckets[lower].pinnedHead >= 0) {
+            s->next[last] = s->buckets[b].pinnedHead;
+            if (s->buckets[b].pinnedHead >= 0)
+                s->prev[s->buckets[b].pinnedHead] = last;
+            s->buckets[b].pinnedHead = s->buckets[lower].pinnedHead;
+        }
+        lfuFreeBucket(s, lower);
+    }
+    s->refs = 0;
+}
+
+//A reference to the page in frame i, which pins it: one bucket up, onto the pinned list
+static void lfuReference(void *state, int frameIndex) {
+    LFUState *s = state;
+    int b = s->bucketOf[frameIndex], up;
+    int freq = s->buckets[b].freq + 1;
+
+    up = s->buckets[b].next;
+    if (up < 0 || s->buckets[up].freq != freq)
+        up = lfuNewBucket(s, freq, b, up);
+    lfuRemove(s, frameIndex);
+    lfuAddPinned(s, frameIndex, up);
+    if (++s->refs >= s->agingPeriod)
+        lfuAge(s);
+}
+
+//Frame i was given a new page, which starts with one reference and is pinned
+static void lfuLoad(void *state, int frameIndex, PageNumber pageNum) {
+    LFUState *s = state;
+
+    lfuRemove(s, frameIndex);
+    lfuAddPinned(s, frameIndex, lfuLowBucket(s, 1));
+    if (++s->refs >= s->agingPeriod)
+        lfuAge(s);
+}
+
+//The last pin of frame i was released: it becomes the most recent candidate of its bucket
+static void lfuUnpin(void *state, int frameIndex) {
+    LFUState *s = state;
+    int b = s->bucketOf[frameIndex];
+
+    if (b < 0 || !s->pinned[frameIndex])
+        return;
+    lfuUnlink(s, frameIndex, b);
+    lfuAdd(s, frameIndex, b, true);
+}
+
+//Frame i lost its page, it has no references and becomes the first victim
+static void lfuEvict(void *state, int frameIndex) {
+    LFUState *s = state;
+
+    lfuRemove(s, frameIndex);
+    lfuAdd(s, frameIndex, lfuLowBucket(s, 0), false);
+}
+
+static int LFU(void *state, BM_BufferPool *const bm, PageNumber pageNum) {
+    LFUState *s = state;
+    int b, f;
+
+    //Only buckets with pinned frames alone are passed over. Flushes pin frames without
+    //taking them off the list, step over those.
+    for (b = s->lowest; b >= 0; b = s->buckets[b].next)
+        for (f = s->buckets[b].tail; f >= 0; f = s->prev[f])
+            if (!isFramePinned(bm, f))
+                return f;
+    return -1;
+}
+
+//The unpinned frames from the lowest bucket up, least recently referenced first in each
+static int lfuNextVictims(void *state, BM_BufferPool *const bm, int *frames, int max) {
+    LFUState *s = state;
+    int b, f, n = 0;
+
+    for (b = s->lowest; b >= 0 && n < max; b = s->buckets[b].next)
+        for (f = s->buckets[b].tail; f >= 0 && n < max; f = s->prev[f])
+            if (!isFramePinned(bm, f))
+                frames[n++] = f;
+    return n;
+}
+
+static void lfuFree(void *state) {
+    LFUState *s = state;
+
+    if (s == NULL)
+        return;
+    free(s->buckets);
+    free(s->bucketOf);
+    free(s->pinned);
+    free(s->prev);
+    free(s->next);
+    free(s);
+}
+
+//Allocates the LFU state of a pool of numPages frames, NULL if memory runs out
+static void *lfuCreate(int numPages, void *stratData) {
+    const BM_LFUParams *params = stratData;
+    LFUState *s = calloc(1, sizeof(LFUState));
+    int i;
+
+    if (s == NULL)
+        return NULL;
+    s->agingPeriod = (params != NULL && params->agingPeriod > 0) ? params->agingPeriod : 10L * numPages;
+    s->buckets = malloc(sizeof(LFUBucket) * (numPages + 1));
+    s->bucketOf = malloc(sizeof(int) * numPages);
+    s->pinned = calloc(numPages, sizeof(bool));
+    s->prev = malloc(sizeof(int) * numPages);
+    s->next = malloc(sizeof(int) * numPages);
+    if (s->buckets == NULL || s->bucketOf == NULL || s->pinned == NULL || s->prev == NULL || s->next == NULL) {
+        lfuFree(s);
+        return NULL;
+    }
+    s->lowest = -1;
+    s->freeBuckets = 0;
+    for (i = 0; i <= numPages; i++)
+        s->buckets[i].next = (i < numPages) ? i + 1 : -1;
+    for (i = 0; i < numPages; i++)
+        s->bucketOf[i] = -1;
+    return s;
+}
+
+//LRU - Least Recently used
+// Replaces the page that has been unpinned the longest time ago.
+// Frames holding an unpinned page form a doubly linked recency list: a pin unlinks the
+// frame, the last unpin puts it back at the head, and the victim is taken from the tail,
+// so neither hits nor evictions look at other frames.
+static void lruUnlink(LRUState *s, int frameIndex) {
+    if (!s->linked[frameIndex])
+        return;
+    if (s->prev[frameIndex] >= 0)
+        s->next[s->prev[frameIndex]] = s->next[frameIndex];
+    else
+        s->head = s->next[frameIndex];
+    if (s->next[frameIndex] >= 0)
+        s->prev[s->next[frameIndex]] = s->prev[frameIndex];
+    else
+        s->tail = s->prev[frameIndex];
+    s->prev[frameIndex] = s->next[frameIndex] = -1;
+    s->linked[frameIndex] = false;
+}
+
+//Links the frame at the head, or at the tail if it holds no page and should be reused first
+static void lruLink(LRUState *s, int frameIndex, bool atHead) {
+    lruUnlink(s, frameIndex);
+    if (atHead) {
+        s->next[frameIndex] = s->head;
+        if (s->head >= 0)
+            s->prev[s->head] = frameIndex;
+        else
+            s->tail = frameIndex;
+        s->head = frameIndex;
+    } else {
+        s->prev[frameIndex] = s->tail;
+        if (s->tail >= 0)
+            s->next[s->tail] = frameIndex;
+        else
+            s->head = frameIndex;
+        s->tail = frameIndex;
+    }
+    s->linked[frameIndex] = true;
+}
+
+//A pinned frame is off the list, on a hit as well as after a load
+static void lruPinned(void *state, int frameIndex) {
+    lruUnlink(state, frameIndex);
+}
+
+static void lruLoad(void *state, int frameIndex, PageNumber pageNum) {
+    lruUnlink(state, frameIndex);
+}
+
+static void lruUnpin(void *state, int frameIndex) {
+    lruLink(state, frameIndex, true);
+}
+
+static void lruEvict(void *state, int frameIndex) {
+    lruLink(state, frameIndex, false);
+}
+
+static int LRU(void *state, BM_BufferPool *const bm, PageNumber pageNum) {
+    LRUState *s = state;
+    int i;
+
+    //Flushes pin frames without taking them off the list, step over those
+    for (i = s->tail; i >= 0; i = s->prev[i])
+        if (!isFramePinned(bm, i))
+            return i;
+    return -1;
+}
+
+//The unpinned frames from the least recently used one on
+static int lruNextVictims(void *state, BM_BufferPool *const bm, int *frames, int max) {
+    LRUState *s = state;
+    int i, n = 0;
+
+    for (i = s->tail; i >= 0 && n < max; i = s->prev[i])
+        if (!isFramePinned(bm, i))
+            frames[n++] = i;
+    return n;
+}
+
+static void lruFree(void *state) {
+    LRUState *s = state;
+
+    if (s == NULL)
+        return;
+    free(s->prev);
+    free(s->next);
+    free(s->linked);
+    free(s);
+}
+
+static void *lruCreate(int numFrames, void *params) {
+    LRUState *s = calloc(1, sizeof(LRUState));
+    int i;
+
+    if (s == NULL)
+        return NULL;
+    s->head = s->tail = -1;
+    s->prev = malloc(sizeof(int) * numFrames);
+    s->next = malloc(sizeof(int) * numFrames);
+    s->linked = calloc(numFrames, sizeof(bool));
+    if (s->prev == NULL || s->next == NULL || s->linked == NULL) {
+        lruFree(s);
+        return NULL;
+    }
+    for (i = 0; i < numFrames; i++)
+        s->prev[i] = s->next[i] = -1;
+    return s;
+}
+
+//CLOCK Replacement stratergy
+// Uses a circular buffer to give pages a second chance before eviction.
+// Pages with a "use" bit set to 1 get a second chance, while 0 are replaced.
+
+//Hits set the use bit and move the hand on by one
+static void clockHit(void *state, int frameIndex) {
+    ClockState *s = state;
+
+    s->used[frameIndex] = true;
+    s->hand = (s->hand + 1) % s->numFrames;
+}
+
+static void clockLoad(void *state, int frameIndex, PageNumber pageNum) {
+    ((ClockState *)state)->used[frameIndex] = true;
+}
+
+//The next search starts after the replaced frame
+static void clockEvict(void *state, int frameIndex) {
+    ((ClockState *)state)->hand = frameIndex + 1;
+}
+
+static int CLOCK(void *state, BM_BufferPool *const bm, PageNumber pageNum) {
+    ClockState *s = state;
+    int i;
+
+    //Two full turns clear every use bit, so an unpinned page is found if there is one
+    for (i = 0; i < 2 * s->numFrames; i++) {
+        s->hand = s->hand % s->numFrames;
+
+        if (!s->used[s->hand] && !isFramePinned(bm, s->hand))
+            return s->hand;
+        //Resetting the reference to 0
+        s->used[s->hand++] = false;
+    }
+    return -1;
+}
+
+//The unpinned frames without a use bit in the order the hand reaches them, then the
+//ones with a use bit, which the hand only takes on its second turn
+static int clockNextVictims(void *state, BM_BufferPool *const bm, int *frames, int max) {
+    ClockState *s = state;
+    int pass, i, f, n = 0;
+
+    for (pass = 0; pass < 2; pass++)
+        for (i = 0; i < s->numFrames && n < max; i++) {
+            f = (s->hand + i) % s->numFrames;
+            if (s->used[f] == (pass == 1) && !isFramePinned(bm, f))
+                frames[n++] = f;
+        }
+    return n;
+}
+
+static void clockFree(void *state) {
+    ClockState *s = state;
+
+    if (s == NULL)
+        return;
+    free(s->used);
+    free(s);
+}
+
+static void *clockCreate(int numFrames, void *params) {
+    ClockState *s = calloc(1, sizeof(ClockState));
+
+    if (s == NULL)
+        return NULL;
+    s->numFrames = numFrames;
+    s->used = calloc(numFrames, sizeof(bool));
+    if (s->used == NULL) {
+        clockFree(s);
+        return NULL;
+    }
+    return s;
+}
+
+//LRU-K - evicts the page whose K-th most recent reference lies furthest back
+// Pages referenced fewer than K times count as infinitely far back and go first, oldest
+// last reference first, so a scan that touches many pages once cannot push out pages
+// that are used again and again. Pins of a page within the correlated reference period
+// of its last pin are one reference, and the history of an evicted page is kept for a while
+// so a page that comes back soon keeps its earlier references.
+
+//True if frame a holds a better victim than frame b
+static inline bool lrukBefore(LRUKState *s, int a, int b) {
+    long ka = s->frames[a].refs[s->k - 1], kb = s->frames[b].refs[s->k - 1];
+
+    return ka < kb || (ka == kb && s->frames[a].last < s->frames[b].last);
+}
+
+static void lrukSwap(LRUKState *s, int i, int j) {
+    int frame = s->heap[i];
+
+    s->heap[i] = s->heap[j];
+    s->heap[j] = frame;
+    s->heapPos[s->heap[i]] = i;
+    s->heapPos[s->heap[j]] = j;
+}
+
+//Moves the frame at heap index i to its place after its key changed
+static void lrukFix(LRUKState *s, int i) {
+    int child;
+
+    while (i > 0 && lrukBefore(s, s->heap[i], s->heap[(i - 1) / 2])) {
+        lrukSwap(s, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+    while ((child = 2 * i + 1) < s->heapSize) {
+        if (child + 1 < s->heapSize && lrukBefore(s, s->heap[child + 1], s->heap[child]))
+            child++;
+        if (!lrukBefore(s, s->heap[child], s->heap[i]))
+            break;
+        lrukSwap(s, i, child);
+        i = child;
+    }
+}
+
+static void lrukPush(LRUKState *s, int frameIndex) {
+    s->heap[s->heapSize] = frameIndex;
+    s->heapPos[frameIndex] = s->heapSize++;
+    lrukFix(s, s->heapSize - 1);
+}
+
+static int lrukPop(LRUKState *s) {
+    int top = s->heap[0];
+
+    lrukSwap(s, 0, --s->heapSize);
+    s->heapPos[top] = -1;
+    if (s->heapSize > 0)
+        lrukFix(s, 0);
+    return top;
+}
+
+//A hit on the page in frame i
+static void lrukReference(void *state, int frameIndex) {
+    LRUKState *s = state;
+    LRUKHistory *h = &s->frames[frameIndex];
+    long period;
+    int i;
+
+    s->now++;
+    if (s->now - h->last > s->correlatedPeriod) {
+        //A new uncorrelated reference. The correlated period that just ended counts as
+        //one reference at its start, so the older ones move forward by its length.
+        period = h->last - h->refs[0];
+        for (i = s->k - 1; i > 0; i--)
+            h->refs[i] = (h->refs[i - 1] != 0) ? h->refs[i - 1] + period : 0;
+        h->refs[0] = s->now;
+    }
+    h->last = s->now;
+    lrukFix(s, s->heapPos[frameIndex]);
+}
+
+//Frame i was given pageNum. The history of the page it held before is retained, and
+//pageNum picks up its own retained history if it was evicted not long ago.
+static void lrukLoad(void *state, int frameIndex, PageNumber pageNum) {
+    LRUKState *s = state;
+    LRUKHistory *h = &s->frames[frameIndex], *r;
+    int slot;
+
+    s->now++;
+    if (h->pageNum != NO_PAGE) {
+        r = &s->retained[s->retainedNext];
+        if (r->pageNum != NO_PAGE)
+            pageTableRemove(&s->retainedIndex, r->pageNum);
+        r->pageNum = h->pageNum;
+        r->last = h->last;
+        memcpy(r->refs, h->refs, sizeof(long) * s->k);
+        pageTableInsert(&s->retainedIndex, r->pageNum, s->retainedNext);
+        s->retainedNext = (s->retainedNext + 1) % s->numRetained;
+    }
+
+    slot = pageTableLookup(&s->retainedIndex, pageNum);
+    if (slot >= 0) {
+        r = &s->retained[slot];
+        memcpy(h->refs + 1, r->refs, sizeof(long) * (s->k - 1));
+        pageTableRemove(&s->retainedIndex, pageNum);
+        r->pageNum = NO_PAGE;
+    } else {
+        memset(h->refs + 1, 0, sizeof(long) * (s->k - 1));
+    }
+    h->refs[0] = s->now;
+    h->last = s->now;
+    h->pageNum = pageNum;
+
+    if (s->heapPos[frameIndex] < 0)
+        lrukPush(s, frameIndex);
+    else
+        lrukFix(s, s->heapPos[frameIndex]);
+}
+
+static int LRU_K(void *state, BM_BufferPool *const bm, PageNumber pageNum) {
+    LRUKState *s = state;
+    int victim = -1, numSkipped = 0;
+
+    //Pinned frames are taken off the top until an unpinned one shows up, then put back
+    while (s->heapSize > 0) {
+        if (!isFramePinned(bm, s->heap[0])) {
+            victim = s->heap[0];
+            break;
+        }
+        s->skipped[numSkipped++] = lrukPop(s);
+    }
+    while (numSkipped > 0)
+        lrukPush(s, s->skipped[--numSkipped]);
+    return victim;
+}
+
+static void lrukFree(void *state) {
+    LRUKState *s = state;
+
+    if (s == NULL)
+        return;
+    pageTableFree(&s->retainedIndex);
+    free(s->refsBlock);
+    free(s->frames);
+    free(s->retained);
+    free(s->heap);
+    free(s->heapPos);
+    free(s->skipped);
+    free(s);
+}
+
+//Allocates the LRU-K state of a pool of numPages frames, NULL if memory runs out
+static void *lrukCreate(int numPages, void *stratData) {
+    const BM_LRUKParams *params = stratData;
+    LRUKState *s = calloc(1, sizeof(LRUKState));
+    int i;
+
+    if (s == NULL)
+        return NULL;
+    s->k = (params != NULL && params->k > 0) ? params->k : 2;
+    s->correlatedPeriod = (params != NULL && params->correlatedPeriod > 0) ? params->correlatedPeriod : 0;
+    s->numRetained = numPages;
+    s->frames = calloc(numPages, sizeof(LRUKHistory));
+    s->retained = calloc(s->numRetained, sizeof(LRUKHistory));
+    s->refsBlock = calloc((size_t)(numPages + s->numRetained) * s->k, sizeof(long));
+    s->heap = malloc(sizeof(int) * numPages);
+    s->heapPos = malloc(sizeof(int) * numPages);
+    s->skipped = malloc(sizeof(int) * numPages);
+    if (s->frames == NULL || s->retained == NULL || s->refsBlock == NULL || s->heap == NULL
+        || s->heapPos == NULL || s->skipped == NULL || pageTableInit(&s->retainedIndex, s->numRetained) != RC_OK) {
+        lrukFree(s);
+        return NULL;
+    }
+    for (i = 0; i < numPages; i++) {
+        s->frames[i].pageNum = NO_PAGE;
+        s->frames[i].refs = s->refsBlock + (size_t)i * s->k;
+        s->heapPos[i] = -1;
+    }
+    for (i = 0; i < s->numRetained; i++) {
+        s->retained[i].pageNum = NO_PAGE;
+        s->retained[i].refs = s->refsBlock + (size_t)(numPages + i) * s->k;
+    }
+    return s;
+}
+
+//Lists shared by ARC and 2Q
+
+static void nodeUnlink(GhostLists *q, int node) {
+    int l = q->list[node];
+
+    if (l == NO_LIST)
+        return;
+    if (q->prev[node] >= 0)
+        q->next[q->prev[node]] = q->next[node];
+    else
+        q->head[l] = q->next[node];
+    if (q->next[node] >= 0)
+        q->prev[q->next[node]] = q->prev[node];
+    else
+        q->tail[l] = q->prev[node];
+    q->size[l]--;
+    q->list[node] = NO_LIST;
+}
+
+//Moves the node to the head of list l
+static void nodePush(GhostLists *q, int node, int l) {
+    nodeUnlink(q, node);
+    q->prev[node] = -1;
+    q->next[node] = q->head[l];
+    if (q->head[l] >= 0)
+        q->prev[q->head[l]] = node;
+    else
+        q->tail[l] = node;
+    q->head[l] = node;
+    q->size[l]++;
+    q->list[node] = l;
+}
+
+//Remembers pageNum at the head of the ghost list l. The caller makes sure a ghost node is unused.
+static void ghostAdd(GhostLists *q, PageNumber pageNum, int l) {
+    int ghost = q->freeGhosts;
+
+    q->freeGhosts = q->next[ghost];
+    q->pages[ghost] = pageNum;
+    pageTableInsert(&q->ghostIndex, pageNum, ghost);
+    nodePush(q, ghost, l);
+}
+
+static void ghostForget(GhostLists *q, int ghost) {
+    nodeUnlink(q, ghost);
+    pageTableRemove(&q->ghostIndex, q->pages[ghost]);
+    q->pages[ghost] = NO_PAGE;
+    q->next[ghost] = q->freeGhosts;
+    q->freeGhosts = ghost;
+}
+
+//Least recently used unpinned frame of list l, -1 if there is none
+static int lastUnpinned(BM_BufferPool *const bm, GhostLists *q, int l) {
+    int node;
+
+    for (node = q->tail[l]; node >= 0; node = q->prev[node])
+        if (!isFramePinned(bm, node))
+            return node;
+    return -1;
+}
+
+static void ghostListsFree(GhostLists *q) {
+    pageTableFree(&q->ghostIndex);
+    free(q->prev);
+    free(q->next);
+    free(q->list);
+    free(q->pages);
+}
+
+//Sets up empty lists for numFrames frames and numGhosts ghosts. On failure the lists
+//must still be freed with ghostListsFree, as long as they were zeroed before.
+static RC ghostListsInit(GhostLists *q, int numFrames, int numGhosts) {
+    int numNodes = numFrames + numGhosts, i;
+
+    q->prev = malloc(sizeof(int) * numNodes);
+    q->next = malloc(sizeof(int) * numNodes);
+    q->list = calloc(numNodes, sizeof(unsigned char));
+    q->pages = malloc(sizeof(PageNumber) * numNodes);
+    if (q->prev == NULL || q->next == NULL || q->list == NULL || q->pages == NULL
+        || pageTableInit(&q->ghostIndex, numGhosts) != RC_OK)
+        return RC_BP_INIT_ERROR;
+    for (i = 0; i < MAX_LISTS; i++) {
+        q->head[i] = q->tail[i] = -1;
+        q->size[i] = 0;
+    }
+    for (i = 0; i < numNodes; i++) {
+        q->pages[i] = NO_PAGE;
+        q->prev[i] = -1;
+        q->next[i] = (i >= numFrames && i + 1 < numNodes) ? i + 1 : -1;
+    }
+    q->freeGhosts = (numGhosts > 0) ? numFrames : -1;
+    return RC_OK;
+}
+
+//ARC - Adaptive Replacement Cache
+// Splits the pool between T1, pages referenced once recently, and T2, pages referenced
+// at least twice, and evicts from T1 while it is larger than its target size p. Evicted
+// pages are remembered as ghosts: a miss on a ghost of T1 shows that T1 was too small and
+// raises p, a miss on a ghost of T2 lowers it, so the split follows the workload. A scan
+// only ever passes through T1 and leaves the pages in T2 alone.
+
+//Target size of T1 once pageNum is loaded, ghost is set to its ghost node or -1. The
+//target moves by the ratio of the ghost list sizes, by at least one frame.
+static int arcTarget(ARCState *s, PageNumber pageNum, int *ghost) {
+    GhostLists *q = &s->lists;
+    int step;
+
+    *ghost = pageTableLookup(&q->ghostIndex, pageNum);
+    if (*ghost < 0)
+        return s->p;
+    if (q->list[*ghost] == ARC_B1) {
+        step = q->size[ARC_B2] / q->size[ARC_B1];
+        step = (step > 1) ? step : 1;
+        return (s->p + step < s->c) ? s->p + step : s->c;
+    }
+    step = q->size[ARC_B1] / q->size[ARC_B2];
+    step = (step > 1) ? step : 1;
+    return (s->p - step > 0) ? s->p - step : 0;
+}
+
+//A hit on the page in frame i, it has now been referenced more than once
+static void arcReference(void *state, int frameIndex) {
+    ARCState *s = state;
+
+    nodePush(&s->lists, frameIndex, ARC_T2);
+}
+
+//Frame i was given pageNum: p is adapted and the ghost lists are trimmed to keep
+//T1 + B1 within c and all four lists within 2c
+static void arcLoad(void *state, int frameIndex, PageNumber pageNum) {
+    ARCState *s = state;
+    GhostLists *q = &s->lists;
+    int ghost;
+
+    s->p = arcTarget(s, pageNum, &ghost);
+    q->pages[frameIndex] = pageNum;
+    if (ghost >= 0) {
+        ghostForget(q, ghost);
+        nodePush(q, frameIndex, ARC_T2);
+    } else {
+        nodePush(q, frameIndex, ARC_T1);
+    }
+
+    while (q->size[ARC_T1] + q->size[ARC_B1] > s->c && q->size[ARC_B1] > 0)
+        ghostForget(q, q->tail[ARC_B1]);
+    while (q->size[ARC_T1] + q->size[ARC_T2] + q->size[ARC_B1] + q->size[ARC_B2] > 2 * s->c
+           && q->size[ARC_B2] > 0)
+        ghostForget(q, q->tail[ARC_B2]);
+}
+
+//Frame i lost its page, which becomes a ghost. The frame waits in ARC_FREE for the next
+//page and is reused before any other if it stays empty.
+static void arcEvict(void *state, int frameIndex) {
+    ARCState *s = state;
+    GhostLists *q = &s->lists;
+
+    if (q->list[frameIndex] == ARC_T1 || q->list[frameIndex] == ARC_T2)
+        ghostAdd(q, q->pages[frameIndex], (q->list[frameIndex] == ARC_T1) ? ARC_B1 : ARC_B2);
+    q->pages[frameIndex] = NO_PAGE;
+    nodePush(q, frameIndex, ARC_FREE);
+}
+
+//Picks the frame for pageNum. Nothing is changed, arcLoad applies the new target once
+//the frame is really taken.
+static int ARC(void *state, BM_BufferPool *const bm, PageNumber pageNum) {
+    ARCState *s = state;
+    GhostLists *q = &s->lists;
+    int victim, ghost, p;
+    bool fromT1;
+
+    victim = lastUnpinned(bm, q, ARC_FREE);
+    if (victim >= 0)
+        return victim;
+    p = arcTarget(s, pageNum, &ghost);
+    fromT1 = q->size[ARC_T1] > 0
+             && (q->size[ARC_T1] > p || (ghost >= 0 && q->list[ghost] == ARC_B2 && q->size[ARC_T1] == p));
+    victim = lastUnpinned(bm, q, fromT1 ? ARC_T1 : ARC_T2);
+    //Every page of the chosen list is pinned, the other list has to give one up
+    if (victim < 0)
+        victim = lastUnpinned(bm, q, fromT1 ? ARC_T2 : ARC_T1);
+    return victim;
+}
+
+static void arcFree(void *state) {
+    ARCState *s = state;
+
+    if (s == NULL)
+        return;
+    ghostListsFree(&s->lists);
+    free(s);
+}
+
+//Allocates the ARC state of a pool of numPages frames, NULL if memory runs out
+static void *arcCreate(int numPages, void *stratData) {
+    ARCState *s = calloc(1, sizeof(ARCState));
+
+    if (s == NULL)
+        return NULL;
+    s->c = numPages;
+    if (ghostListsInit(&s->lists, numPages, 2 * numPages) != RC_OK) {
+        arcFree(s);
+        return NULL;
+    }
+    return s;
+}
+
+//2Q - Two queues
+// Pages seen for the first time go into A1in, a FIFO queue that holds a small part of the
+// pool, and hits there change nothing, so pins that follow each other closely count once.
+// Once A1in holds more than inSize frames its oldest page is evicted and remembered in the
+// ghost queue A1out. Only a page pinned again while A1out still remembers it enters Am,
+// the main LRU list, so a scan cycles through A1in and leaves the pages in Am alone.
+
+//A hit on the page in frame i. Pages in A1in keep their place.
+static void twoQReference(void *state, int frameIndex) {
+    TwoQState *s = state;
+
+    if (s->lists.list[frameIndex] == TWOQ_AM)
+        nodePush(&s->lists, frameIndex, TWOQ_AM);
+}
+
+//Frame i was given pageNum, which goes into Am if A1out remembered it and into A1in
+//otherwise. A1out is trimmed only afterwards, so the ghost that sends pageNum to Am
+//cannot be dropped by the eviction that made room for it.
+static void twoQLoad(void *state, int frameIndex, PageNumber pageNum) {
+    TwoQState *s = state;
+    GhostLists *q = &s->lists;
+    int ghost = pageTableLookup(&q->ghostIndex, pageNum);
+
+    if (ghost >= 0)
+        ghostForget(q, ghost);
+    while (q->size[TWOQ_A1OUT] > s->outSize)
+        ghostForget(q, q->tail[TWOQ_A1OUT]);
+    q->pages[frameIndex] = pageNum;
+    nodePush(q, frameIndex, (ghost >= 0) ? TWOQ_AM : TWOQ_A1IN);
+}
+
+//Frame i lost its page. A page that leaves A1in is remembered in A1out, the frame waits
+//in TWOQ_FREE for the next page and is reused before any other if it stays empty.
+static void twoQEvict(void *state, int frameIndex) {
+    TwoQState *s = state;
+    GhostLists *q = &s->lists;
+
+    if (q->list[frameIndex] == TWOQ_A1IN) {
+        if (q->freeGhosts < 0)
+            ghostForget(q, q->tail[TWOQ_A1OUT]);
+        ghostAdd(q, q->pages[frameIndex], TWOQ_A1OUT);
+    }
+    q->pages[frameIndex] = NO_PAGE;
+    nodePush(q, frameIndex, TWOQ_FREE);
+}
+
+static int TwoQ(void *state, BM_BufferPool *const bm, PageNumber pageNum) {
+    TwoQState *s = state;
+    GhostLists *q = &s->lists;
+    int victim;
+    bool fromIn;
+
+    victim = lastUnpinned(bm, q, TWOQ_FREE);
+    if (victim >= 0)
+        return victim;
+    fromIn = q->size[TWOQ_A1IN] > s->inSize || q->size[TWOQ_AM] == 0;
+    victim = lastUnpinned(bm, q, fromIn ? TWOQ_A1IN : TWOQ_AM);
+    //Every page of the chosen queue is pinned, the other one has to give one up
+    if (victim < 0)
+        victim = lastUnpinned(bm, q, fromIn ? TWOQ_AM : TWOQ_A1IN);
+    return victim;
+}
+
+static void twoQFree(void *state) {
+    TwoQState *s = state;
+
+    if (s == NULL)
+        return;
+    ghostListsFree(&s->lists);
+    free(s);
+}
+
+//Allocates the 2Q state of a pool of numPages frames, NULL if memory runs out
+static void *twoQCreate(int numPages, void *stratData) {
+    const BM_2QParams *params = stratData;
+    TwoQState *s = calloc(1, sizeof(TwoQState));
+
+    if (s == NULL)
+        return NULL;
+    s->inSize = (params != NULL && params->inSize > 0) ? params->inSize : numPages / 4;
+    s->outSize = (params != NULL && params->outSize > 0) ? params->outSize : numPages / 2;
+    if (s->inSize < 1)
+        s->inSize = 1;
+    if (s->outSize < 1)
+        s->outSize = 1;
+    if (ghostListsInit(&s->lists, numPages, s->outSize + 1) != RC_OK) {
+        twoQFree(s);
+        return NULL;
+    }
+    return s;
+}
+
+//The built in strategies, in the order of ReplacementStrategy
+static const BM_ReplacementPolicy builtinPolicies[] = {
+    {"FIFO", fifoCreate, free, fifoLoad, NULL, NULL, NULL, FIFO, fifoNextVictims, NULL},
+    {"LRU", lruCreate, lruFree, lruLoad, lruPinned, lruUnpin, lruEvict, LRU, lruNextVictims, NULL},
+    {"CLOCK", clockCreate, clockFree, clockLoad, clockHit, NULL, clockEvict, CLOCK, clockNextVictims, NULL},
+    {"LFU", lfuCreate, lfuFree, lfuLoad, lfuReference, lfuUnpin, lfuEvict, LFU, lfuNextVictims, NULL},
+    {"LRU-K", lrukCreate, lrukFree, lrukLoad, lrukReference, NULL, NULL, LRU_K, NULL, NULL},
+    {"ARC", arcCreate, arcFree, arcLoad, arcReference, NULL, arcEvict, ARC, NULL, NULL},
+    {"2Q", twoQCreate, twoQFree, twoQLoad, twoQReference, NULL, twoQEvict, TwoQ, NULL, NULL},
+};
+
+//Admission filter
+// With an admission filter, a miss that would replace a page only goes ahead if the new
+// page was referenced more often lately than the victim, as estimated by TinyLFU. A page
+// that loses is read into the bypass frame instead and leaves the pool again when its
+// last pin is released, so one-off pages cannot push out pages that are used a lot.
+
+//Hashes of a page, the sketch rows and the doorkeeper probe h1 + i * h2
+static inline void admissionHash(PageNumber pageNum, unsigned int *h1, unsigned int *h2) {
+    unsigned long long x = (unsigned int)pageNum;
+
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    *h1 = (unsigned int)x;
+    *h2 = (unsigned int)(x >> 32) | 1;
+}
+
+static bool doorkeeperTestAndSet(AdmissionFilter *f, unsigned int h1, unsigned int h2) {
+    unsigned int bit1 = h1 & f->doorMask, bit2 = (h1 + h2) & f->doorMask;
+    unsigned long mask1 = 1UL << (bit1 % (8 * sizeof(unsigned long)));
+    unsigned long mask2 = 1UL << (bit2 % (8 * sizeof(unsigned long)));
+    unsigned long *word1 = &f->doorkeeper[bit1 / (8 * sizeof(unsigned long))];
+    unsigned long *word2 = &f->doorkeeper[bit2 / (8 * sizeof(unsigned long))];
+    bool present = (*word1 & mask1) && (*word2 & mask2);
+
+    *word1 |= mask1;
+    *word2 |= mask2;
+    return present;
+}
+
+static int sketchMin(AdmissionFilter *f, unsigned int h1, unsigned int h2) {
+    int i, count, min = SKETCH_MAX;
+
+    for (i = 0; i < SKETCH_DEPTH; i++) {
+        count = f->counters[(size_t)i * (f->widthMask + 1) + ((h1 + i * h2) & f->widthMask)];
+        if (count < min)
+            min = count;
+    }
+    return min;
+}
+
+//Halves every counter and clears the doorkeeper
+static void admissionReset(AdmissionFilter *f) {
+    size_t i, numCounters = (size_t)SKETCH_DEPTH * (f->widthMask + 1);
+
+    for (i = 0; i < numCounters; i++)
+        f->counters[i] >>= 1;
+    memset(f->doorkeeper, 0, (f->doorMask + 1) / 8);
+    f->additions = 0;
+}
+
+//Counts a reference to pageNum. Only the smallest counters are raised (conservative
+//update), which keeps pages sharing a counter from inflating each other.
+static void admissionRecord(AdmissionFilter *f, PageNumber pageNum) {
+    unsigned int h1, h2;
+    int i, min;
+    unsigned char *counter;
+
+    admissionHash(pageNum, &h1, &h2);
+    if (doorkeeperTestAndSet(f, h1, h2)) {
+        min = sketchMin(f, h1, h2);
+        for (i = 0; i < SKETCH_DEPTH && min < SKETCH_MAX; i++) {
+            counter = &f->counters[(size_t)i * (f->widthMask + 1) + ((h1 + i * h2) & f->widthMask)];
+            if (*counter == min)
+                (*counter)++;
+        }
+    }
+    if (++f->additions >= f->sampleSize)
+        admissionReset(f);
+}
+
+//Estimated references to pageNum since the counters were last halved
+static int admissionEstimate(AdmissionFilter *f, PageNumber pageNum) {
+    unsigned int h1, h2;
+    unsigned int bit1, bit2;
+    int estimate;
+
+    admissionHash(pageNum, &h1, &h2);
+    estimate = sketchMin(f, h1, h2);
+    bit1 = h1 & f->doorMask;
+    bit2 = (h1 + h2) & f->doorMask;
+    if ((f->doorkeeper[bit1 / (8 * sizeof(unsigned long))] >> (bit1 % (8 * sizeof(unsigned long))) & 1)
+        && (f->doorkeeper[bit2 / (8 * sizeof(unsigned long))] >> (bit2 % (8 * sizeof(unsigned long))) & 1))
+        estimate++;
+    return estimate;
+}
+
+static void admissionFree(AdmissionFilter *f) {
+    if (f == NULL)
+        return;
+    free(f->counters);
+    free(f->doorkeeper);
+    free(f);
+}
+
+//Allocates the filter of a pool of numPages frames, NULL if memory runs out. Each row has
+//twice as many counters as there are frames and the counts are halved after ten
+//references per frame.
+static AdmissionFilter *admissionCreate(int numPages) {
+    AdmissionFilter *f = calloc(1, sizeof(AdmissionFilter));
+    int width = 64;
+
+    if (f == NULL)
+        return NULL;
+    while (width < 2 * numPages)
+        width <<= 1;
+    f->widthMask = width - 1;
+    f->doorMask = 8 * width - 1;
+    f->sampleSize = 10L * numPages;
+    f->counters = calloc((size_t)SKETCH_DEPTH * width, 1);
+    f->doorkeeper = calloc(width, 1);
+    if (f->counters == NULL || f->doorkeeper == NULL) {
+        admissionFree(f);
+        return NULL;
+    }
+    return f;
+}
 
-// Function prototypes
-extern void FIFO(BM_BufferPool *const bm, PageFrame *page);
-extern void LFU(BM_BufferPool *const bm, PageFrame *page);
-extern void LRU(BM_BufferPool *const bm, PageFrame *page);
-extern void CLOCK(BM_BufferPool *const bm, PageFrame *page);
+//True if pageNum should replace the page victim. Runs under policyLock.
+static bool admitPage(BM_PoolMgmt *mgmt, PageNumber pageNum, PageNumber victim) {
+    return admissionEstimate(mgmt->admission, pageNum) > admissionEstimate(mgmt->admission, victim);
+}
 
-extern RC initBufferPool(BM_BufferPool *const bm, const char *const pageFileName,const int numPages, ReplacementStrategy strategy, void *stratData);
+//True if the handle points into the bypass frame
+static inline bool isBypassed(BM_PoolMgmt *mgmt, BM_PageHandle *const page) {
+    return mgmt->bypass >= 0 && page->data == mgmt->frames[mgmt->bypass].data;
+}
 
-extern RC shutdownBufferPool(BM_BufferPool *const bm);
-extern RC forceFlushPool(BM_BufferPool *const bm);
-extern RC markDirty(BM_BufferPool *const bm, BM_PageHandle *const page);
-extern RC unpinPage(BM_BufferPool *const bm, BM_PageHandle *const page);
-extern RC forcePage(BM_BufferPool *const bm, BM_PageHandle *const page);
-extern RC pinPage(BM_BufferPool *const bm, BM_PageHandle *const page,
-                   const PageNumber pageNum);
+//Drops a pin of the bypass frame. The last one writes the page back if it was changed,
+//the frame then holds no page any more.
+static RC unpinBypass(BM_BufferPool *const bm) {
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bm->mgmtData;
+    PageFrame *frame = &mgmt->frames[mgmt->bypass];
+    RC rc = RC_OK;
+
+    lockPolicy(mgmt);
+    //Another client may pin the page and change it while the lock is dropped for the write
+    while (frame->fixCount == 1 && frame->dirtyBit == 1 && rc == RC_OK) {
+        unlockPolicy(mgmt);
+        rc = writeFrame(bm, mgmt->bypass);
+        lockPolicy(mgmt);
+    }
+    if (--frame->fixCount == 0)
+        frame->pageNum = NO_PAGE;
+    unlockPolicy(mgmt);
+    return rc;
+}
 
-extern PageNumber *getFrameContents(BM_BufferPool *const bm);
-extern bool *getDirtyFlags(BM_BufferPool *const bm);
-extern int *getFixCounts(BM_BufferPool *const bm);
-extern int getNumReadIO(BM_BufferPool *const bm);
-extern int getNumWriteIO(BM_BufferPool *const bm);
+//Frame of the next ring slot if a sequential miss can recycle it: the frame still holds
+//the page the ring read into it and nobody has it pinned. -1 otherwise, and the slot is
+//then filled the usual way. Runs under policyLock.
+static int ringVictim(BM_PoolMgmt *mgmt) {
+    int i = mgmt->ring[mgmt->ringNext];
 
-//Replacement Stratergies - FIFO (First In First Out)
+    if (i < 0 || mgmt->frames[i].pageNum != mgmt->ringPages[mgmt->ringNext] || mgmt->frames[i].fixCount != 0
+        || mgmt->frames[i].ioInProgress)
+        return -1;
+    return i;
+}
 
-//FIFO:
-// Replaces the oldest page in the buffer, following a queue-like structure.
-// The page loaded first is the first removed from the buffer.
-extern void FIFO(BM_BufferPool *const bm, PageFrame *page) {
-    PageFrame *pageFrame = (PageFrame *)bm->mgmtData;
-    int i, from_index_FIFO;
-    //track-page is used to track the page at front of FIFO queue
+//Puts frame i, just given pageNum by a sequential miss, into the next ring slot
+static void ringRecord(BM_PoolMgmt *mgmt, int frameIndex, PageNumber pageNum) {
+    mgmt->ring[mgmt->ringNext] = frameIndex;
+    mgmt->ringPages[mgmt->ringNext] = pageNum;
+    mgmt->ringNext = (mgmt->ringNext + 1) % mgmt->ringSize;
+}
 
-    from_index_FIFO = last_index_bp % buffer_size;
+//Use the pool's replacement strategy to choose a frame for pageNum
+static int pickVictim(BM_BufferPool *const bm, PageNumber pageNum) {
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bm->mgmtData;
 
-    for (i = 0; i < buffer_size; i++) {
-        //Find the suitable page to replace
-        if (pageFrame[from_index_FIFO].fixCount == 0) { //Check if the track_page is not currently in use
-            //Check if the page is modified
-            if (pageFrame[from_index_FIFO].dirtyBit == 1) {
-                SM_FileHandle fh;
-                openPageFile(bm->pageFile, &fh); //Open the page for writing
-                //Writing the contents of the dirty page back at disk
-                writeBlock(pageFrame[from_index_FIFO].pageNum, &fh, pageFrame[from_index_FIFO].data);
-
-                track_write_count++;
-            }
-            
-            //Replace all the data, pageNum, dirtyBit, fixCount with new page's data
-            pageFrame[from_index_FIFO].data = page->data;
-            pageFrame[from_index_FIFO].pageNum = page->pageNum;
-            pageFrame[from_index_FIFO].dirtyBit = page->dirtyBit;
-            pageFrame[from_index_FIFO].fixCount = page->fixCount;
-            break;
-        } else {
-            from_index_FIFO++;  // Move to the next page buffer
-            from_index_FIFO = (from_index_FIFO % buffer_size == 0) ? 0 : from_index_FIFO;
-        }
-    }
+    return mgmt->policy->pickVictim(mgmt->policyState, bm, pageNum);
 }
 
-//LFU - Least Frequently used 
-// Replaces the page with the lowest access frequency over time.
-// Gives more priority to pages that have been accessed the least number of times.
-extern void LFU(BM_BufferPool *const bm, PageFrame *page) {
-    PageFrame *pageFrame = (PageFrame *)bm->mgmtData;
-    int i, j, least_freq_index, lf_ref_pointer;
-    //Get the least frequency index from the track position  
-    least_freq_index = lfu_pointer;
+//Update the replacement state for a page that was already in the buffer
+static void policyOnHit(BM_BufferPool *const bm, int frameIndex) {
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bm->mgmtData;
 
-    for (i = 0; i < buffer_size; i++) {
-        //Find an unpinned page and then update the least_freq_index
-        if (pageFrame[least_freq_index].fixCount == 0) {
-            least_freq_index = (least_freq_index + i) % buffer_size;
-            lf_ref_pointer = pageFrame[least_freq_index].refNum;
-            break;
-        }
-    }
+    lockPolicy(mgmt);
+    if (mgmt->admission != NULL)
+        admissionRecord(mgmt->admission, mgmt->frames[frameIndex].pageNum);
+    if (mgmt->policy->onHit != NULL)
+        mgmt->policy->onHit(mgmt->policyState, frameIndex);
+    unlockPolicy(mgmt);
+}
 
-    i = (least_freq_index + 1) % buffer_size;
+//Update the replacement state for a frame that has just been given a new page.
+//Runs under policyLock.
+static void policyOnLoad(BM_BufferPool *const bm, int frameIndex) {
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bm->mgmtData;
 
-    for (j = 0; j < buffer_size; j++) {
-        //Find the page with the lowest reference count
-        if (pageFrame[i].refNum < lf_ref_pointer) {
-            least_freq_index = i;
-            lf_ref_pointer = pageFrame[i].refNum;
-        }
-        i = (i + 1) % buffer_size;
-    }
-    //If page is dirty, write to the disk
-    if (pageFrame[least_freq_index].dirtyBit == 1) {
-        SM_FileHandle fh;
-        openPageFile(bm->pageFile, &fh);
-        writeBlock(pageFrame[least_freq_index].pageNum, &fh, pageFrame[least_freq_index].data);
+    if (mgmt->policy->onLoad != NULL)
+        mgmt->policy->onLoad(mgmt->policyState, frameIndex, mgmt->frames[frameIndex].pageNum);
+}
 
-        //Increment as the number of writes to the disk
-        track_write_count++;
-    }
+//Update the replacement state for a frame whose last client pin was released. Runs
+//under the partition lock of the frame's page, so a new pin cannot slip in between.
+static void policyOnUnpin(BM_BufferPool *const bm, int frameIndex) {
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bm->mgmtData;
 
+    if (mgmt->policy->onUnpin == NULL)
+        return;
+    lockPolicy(mgmt);
+    mgmt->policy->onUnpin(mgmt->policyState, frameIndex);
+    unlockPolicy(mgmt);
+}
 
+//Update the replacement state for a frame that lost its page, either to make room for
+//another one or because it could not be read. Runs under policyLock.
+static void policyOnEvict(BM_BufferPool *const bm, int frameIndex) {
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bm->mgmtData;
 
+    if (mgmt->policy->onEvict != NULL)
+        mgmt->policy->onEvict(mgmt->policyState, frameIndex);
+}
 
-    //Replace the least frequently used page with new page
-    pageFrame[least_freq_index].data = page->data;
-    pageFrame[least_freq_index].pageNum = page->pageNum;
-    pageFrame[least_freq_index].dirtyBit = page->dirtyBit;
-    pageFrame[least_freq_index].fixCount = page->fixCount;
-    //Update the LFU pointer for the next replacement
-    lfu_pointer = least_freq_index + 1;
+//Stride and correlation prefetcher
+// A pool with BM_PoolOptions.prefetcher learns from the pages its misses and speculative
+// hits go to. A distance between two of them that repeats STRIDE_CONFIDENCE times in a row
+// is a stride, and the next STRIDE_DEGREE pages along it are loaded, a few at a time once
+// the walk has used up half of them. Every page also keeps the pages that followed it most
+// often in a set associative table with an entry per page of the file, a Markov model of
+// the misses, and a successor that followed MARKOV_CONFIDENCE times is loaded as soon as
+// the page comes up again. Each speculative read takes a credit of the budget and a hit on
+// the page gives it back, so pages read in vain use the budget up. Then the prefetcher only
+// gets a credit back every PREFETCH_REFILL pages it sees.
+
+static void prefetcherFree(Prefetcher *pf) {
+    if (pf == NULL)
+        return;
+    free(pf->table);
+    free(pf);
 }
 
-//LRU - Least Recently used
-// Replaces the least recently used page, prioritizing frequently accessed pages.
-// Tracks page access history to identify the least recently accessed page.
-extern void LRU(BM_BufferPool *const bm, PageFrame *page) {
-    PageFrame *pageFrame = (PageFrame *)bm->mgmtData;
-    int i, least_hit_index = 0, least_hit_num;
-
-    //Looping through all the pages to find the first unpinned page
-    for (i = 0; i < buffer_size; i++) {
-        if (pageFrame[i].fixCount == 0) {
-            least_hit_index = i;
-            //Replace the recently used page with the first unpinned page
-            least_hit_num = pageFrame[i].hitNum;
-            break;
+//Allocates the prefetcher of a pool of numPages frames on a file of filePages pages, NULL
+//if memory runs out. The successor table tracks every page of the file up to a limit, the
+//misses of a pool smaller than its working set would otherwise keep replacing each other.
+static Prefetcher *prefetcherCreate(int numPages, int filePages, int budget) {
+    Prefetcher *pf = calloc(1, sizeof(Prefetcher));
+    int entries = 64, bits = 4, tracked = (filePages > numPages) ? filePages : numPages, i, j;
+
+    if (pf == NULL)
+        return NULL;
+    while (entries < tracked && entries < MAX_MARKOV_ENTRIES) {
+        entries <<= 1;
+        bits++;
+    }
+    //A set of 16 byte entries fills one cache line
+    if (posix_memalign((void **)&pf->table, 64, sizeof(Successors) * entries) != 0)
+        pf->table = NULL;
+    if (pf->table == NULL) {
+        prefetcherFree(pf);
+        return NULL;
+    }
+    for (i = 0; i < entries; i++) {
+        pf->table[i].page = NO_PAGE;
+        for (j = 0; j < MARKOV_WAYS; j++) {
+            pf->table[i].next[j] = NO_PAGE;
+            pf->table[i].count[j] = 0;
         }
     }
+    pf->shift = 32 - bits;
+    //Like read-ahead, a stride takes no more than a quarter of the pool
+    pf->degree = (numPages / 4 < STRIDE_DEGREE) ? numPages / 4 : STRIDE_DEGREE;
+    pf->last = NO_PAGE;
+    pf->budget = (budget > 0) ? budget : DEFAULT_PREFETCH_BUDGET;
+    pf->credit = pf->budget;
+    return pf;
+}
 
-    for (i = least_hit_index + 1; i < buffer_size; i++) {
-        //Find the page which is least recently used
-        if (pageFrame[i].hitNum < least_hit_num) {
-            least_hit_index = i;
-            least_hit_num = pageFrame[i].hitNum;
+//Entry of pageNum, moved to the front of its set. A page without one gets the least
+//recently used entry of the set if insert is set, otherwise NULL is returned.
+static Successors *successorsOf(Prefetcher *pf, PageNumber pageNum, bool insert) {
+    Successors *set = &pf->table[(((unsigned int)pageNum * 2654435769u) >> pf->shift) * MARKOV_ASSOC];
+    Successors e;
+    int w, j;
+
+    for (w = 0; w < MARKOV_ASSOC - 1 && set[w].page != pageNum; w++)
+        ;
+    if (set[w].page != pageNum) {
+        if (!insert)
+            return NULL;
+        set[w].page = pageNum;
+        for (j = 0; j < MARKOV_WAYS; j++) {
+            set[w].next[j] = NO_PAGE;
+            set[w].count[j] = 0;
         }
     }
+    e = set[w];
+    memmove(&set[1], &set[0], sizeof(Successors) * w);
+    set[0] = e;
+    return &set[0];
+}
+
+//Counts next as a successor of pageNum. A new successor replaces the weaker one.
+static void learnSuccessor(Prefetcher *pf, PageNumber pageNum, PageNumber next) {
+    Successors *e = successorsOf(pf, pageNum, true);
+    PageNumber page;
+    unsigned char count;
+    int j;
+
+    for (j = 0; j < MARKOV_WAYS - 1 && e->next[j] != next; j++)
+        ;
+    if (e->next[j] != next) {
+        e->next[j] = next;
+        e->count[j] = 0;
+    }
+    if (e->count[j] < MARKOV_MAX_COUNT)
+        e->count[j]++;
+    //Keep the most frequent successors first
+    for (; j > 0 && e->count[j] > e->count[j - 1]; j--) {
+        page = e->next[j];
+        count = e->count[j];
+        e->next[j] = e->next[j - 1];
+        e->count[j] = e->count[j - 1];
+        e->next[j - 1] = page;
+        e->count[j - 1] = count;
+    }
+}
 
-    //If recently used page is dirty then write it to disk
-    if (pageFrame[least_hit_index].dirtyBit == 1) {
-        SM_FileHandle fh;
-        openPageFile(bm->pageFile, &fh);
-        //Write in the page in the chosen pagenumber in the specific pageFrame
-        writeBlock(pageFrame[least_hit_index].pageNum, &fh, pageFrame[least_hit_index].data);
+//Frame memory
 
-        track_write_count++;
+//Allocates the frame arena. Plain pools use posix_memalign. Huge pages and NUMA
+//placement need an mmap'd region: MAP_HUGETLB is tried first, and if no huge pages
+//are reserved the region is mapped normally and offered to transparent huge pages.
+static RC allocArena(BM_PoolMgmt *mgmt, int numPages, const BM_PoolOptions *const options) {
+    size_t size = (size_t)numPages * PAGE_SIZE;
+    void *arena = MAP_FAILED;
+
+    if (!options->hugePages && options->numaNode < 0) {
+        if (posix_memalign((void **)&mgmt->arena, FRAME_ALIGNMENT, size) != 0)
+            return RC_BP_INIT_ERROR;
+        mgmt->arenaSize = 0;
+        return RC_OK;
     }
 
-    // Replace the least recently used page with the new page
-    pageFrame[least_hit_index].data = page->data;
+    if (options->hugePages) {
+        size = (size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+#ifdef MAP_HUGETLB
+        arena = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+    }
+    if (arena == MAP_FAILED) {
+        arena = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (arena == MAP_FAILED)
+            return RC_BP_INIT_ERROR;
+#ifdef MADV_HUGEPAGE
+        if (options->hugePages)
+            madvise(arena, size, MADV_HUGEPAGE);
+#endif
+    }
 
-    pageFrame[least_hit_index].pageNum = page->pageNum;
+    //Bind before the first touch, the pages are placed when they are first written.
+    //A kernel without NUMA support rejects the call and the memory stays where it lands.
+    if (options->numaNode >= 0 && options->numaNode < (int)(8 * sizeof(unsigned long))) {
+#ifdef SYS_mbind
+        unsigned long nodeMask = 1UL << options->numaNode;
+        syscall(SYS_mbind, arena, size, MPOL_BIND, &nodeMask, 8 * sizeof(nodeMask), 0);
+#endif
+    }
 
-    pageFrame[least_hit_index].dirtyBit = page->dirtyBit;
+    mgmt->arena = arena;
+    mgmt->arenaSize = size;
+    return RC_OK;
+}
 
-    pageFrame[least_hit_index].fixCount = page->fixCount;
-    
-    pageFrame[least_hit_index].hitNum = page->hitNum;
+static void freeArena(BM_PoolMgmt *mgmt) {
+    if (mgmt->arena == NULL)
+        return;
+    if (mgmt->arenaSize != 0)
+        munmap(mgmt->arena, mgmt->arenaSize);
+    else
+        free(mgmt->arena);
+    mgmt->arena = NULL;
 }
 
-//CLOCK Replacement stratergy
-// Uses a circular buffer to give pages a second chance before eviction.
-// Pages with a "use" bit set to 1 get a second chance, while 0 are replaced.
+//Ends the write of a run of numPages dirty pages picked up by flushEntries: counts the
+//pages, or marks them dirty again if the write failed, then releases their frames
+//and wakes writeFrame calls waiting for them
+static RC finishFlushRun(BM_PoolMgmt *mgmt, FlushEntry *run, int numPages, RC rc) {
+    int k;
+
+    for (k = 0; k < numPages; k++) {
+        lockFrame(mgmt, run[k].frame);
+        if (rc == RC_OK)
+            mgmt->writeCount++;
+        else
+            setDirty(mgmt, run[k].frame, 1);
+        mgmt->frames[run[k].frame].writeInProgress = 0;
+        if (mgmt->concurrent)
+            pthread_cond_broadcast(&mgmt->latches[run[k].frame].ioDone);
+        unlockFrame(mgmt, run[k].frame);
+        mgmt->frames[run[k].frame].fixCount--;
+    }
+    return rc;
+}
 
-extern void CLOCK(BM_BufferPool *const bm, PageFrame *page) {
-    PageFrame *pageFrame = (PageFrame *)bm->mgmtData;
-    //While loop until an unpinned page is found
-    while (1) {
-        clock_pointer = (clock_pointer % buffer_size == 0) ? 0 : clock_pointer;
+//Writes the dirty pages of the numEntries frames in entries, each given with the page the
+//caller saw in it, and waits until they are on disk. Frames that got another page, were
+//pinned or were cleaned meanwhile are skipped. entries is overwritten.
+static RC flushEntries(BM_BufferPool *const bm, FlushEntry *entries, int numEntries) {
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bm->mgmtData;
+    PageFrame *pageFrame = mgmt->frames;
+    IO_Request *req;
+    SM_PageHandle *runPages;
+    int *batch;
+    int i, numPinned = 0, numDirty = 0, numRuns = 0;
+    RC rc = RC_OK;
+
+    if (numEntries == 0)
+        return RC_OK;
+    batch = malloc(sizeof(int) * numEntries);
+    runPages = malloc(sizeof(SM_PageHandle) * numEntries);
+    if (batch == NULL || runPages == NULL) {
+        free(batch);
+        free(runPages);
+        return RC_BP_FLUSHPOOL_FAILED;
+    }
 
-        if (pageFrame[clock_pointer].hitNum == 0) {
-            //If page is dirty write it to the disk
-            if (pageFrame[clock_pointer].dirtyBit == 1) {
-                SM_FileHandle fh;
-                openPageFile(bm->pageFile, &fh);
-                writeBlock(pageFrame[clock_pointer].pageNum, &fh, pageFrame[clock_pointer].data);
+    //Pin every frame first. Page table locks are only taken here, before any
+    //frame latch is held, so the flush keeps the pool's lock order.
+    for (i = 0; i < numEntries; i++) {
+        int frameIndex = entries[i].frame;
+
+        //Pin the frame while writing, so it cannot be given to another page meanwhile
+        if (!pinFrameIfHolds(mgmt, frameIndex, entries[i].pageNum))
+            continue;
+        if (pageFrame[frameIndex].fixCount != 1)
+            pageFrame[frameIndex].fixCount--;
+        else
+            batch[numPinned++] = frameIndex;
+    }
 
-                //incrementing write for statistical function
-                track_write_count++;
-            }
+    //Mark the pinned frames that are still dirty as being written. Each latch is only held
+    //while the frame's state changes, so a flush of many pages never holds many latches and
+    //markDirty does not wait for the writes. writeFrame waits for writeInProgress instead.
+    for (i = 0; i < numPinned; i++) {
+        int frameIndex = batch[i];
+
+        lockFrame(mgmt, frameIndex);
+        if (pageFrame[frameIndex].dirtyBit != 1) {
+            unlockFrame(mgmt, frameIndex);
+            pageFrame[frameIndex].fixCount--;
+            continue;
+        }
+        //Clear the dirty bit before writing so a markDirty racing with the write is not lost
+        setDirty(mgmt, frameIndex, 0);
+        pageFrame[frameIndex].writeInProgress = 1;
+        unlockFrame(mgmt, frameIndex);
+        entries[numDirty].pageNum = pageFrame[frameIndex].pageNum;
+        entries[numDirty].frame = frameIndex;
+        numDirty++;
+    }
 
-            //Replacing the page in buffer with new page
-            pageFrame[clock_pointer].data = page->data;
-            pageFrame[clock_pointer].pageNum = page->pageNum;
-            pageFrame[clock_pointer].dirtyBit = page->dirtyBit;
-            pageFrame[clock_pointer].fixCount = page->fixCount;
-            pageFrame[clock_pointer].hitNum = page->hitNum;
-            //Increment the clock_pointer
-            clock_pointer++;
-            break;
+    //Pages that follow each other on disk are written with one vectored request, whatever
+    //frames they sit in. All runs are queued before waiting, so the engine keeps many
+    //writes in flight instead of doing them one after another. An mmap pool syncs each
+    //run of its mapping right away instead.
+    qsort(entries, numDirty, sizeof(FlushEntry), compareFlushEntries);
+    for (i = 0; i < numDirty; i += req->numPages) {
+        req = &mgmt->ioRequests[entries[i].frame];
+        req->op = IO_WRITE;
+        req->pageNum = entries[i].pageNum;
+        req->data = pageFrame[entries[i].frame].data;
+        req->pages = &runPages[i];
+        req->numPages = 0;
+        while (i + req->numPages < numDirty && req->numPages < IO_MAX_RUN
+               && entries[i + req->numPages].pageNum == req->pageNum + req->numPages) {
+            runPages[i + req->numPages] = pageFrame[entries[i + req->numPages].frame].data;
+            req->numPages++;
+        }
+        req->onComplete = NULL;
+        req->userData = mgmt;
+        if (mgmt->map != NULL) {
+            if (finishFlushRun(mgmt, &entries[i], req->numPages, syncPages(req->data, req->numPages)) != RC_OK)
+                rc = RC_BP_FLUSHPOOL_FAILED;
+        } else if (startIO(mgmt->io, req) != RC_OK) {
+            finishFlushRun(mgmt, &entries[i], req->numPages, RC_WRITE_FAILED);
+            rc = RC_BP_FLUSHPOOL_FAILED;
         } else {
-            //Resetting the reference to 0
-            pageFrame[clock_pointer++].hitNum = 0;
+            batch[numRuns++] = i;
+        }
+    }
+    if (mgmt->io != NULL)
+        submitIO(mgmt->io);
+
+    for (i = 0; i < numRuns; i++) {
+        req = &mgmt->ioRequests[entries[batch[i]].frame];
+        if (finishFlushRun(mgmt, &entries[batch[i]], req->numPages, waitIO(mgmt->io, req)) != RC_OK)
+            rc = RC_BP_FLUSHPOOL_FAILED;
+    }
+    free(batch);
+    free(runPages);
+    return rc;
+}
+
+//Background writer
+// A pool with BM_PoolOptions.backgroundWriter runs a thread that writes dirty pages back
+// before the replacement strategy gets to them, so misses mostly find a clean victim and
+// do not wait for a write. Every bgWriterDelay milliseconds, or as soon as dirtyWatermark
+// percent of the frames are dirty, it asks the strategy for its next victims and writes
+// up to bgWriterMaxPages of the dirty unpinned ones, in runs like forceFlushPool. A
+// strategy that cannot list its victims gets its frames swept round robin instead.
+
+static void writerFree(BackgroundWriter *w) {
+    if (w == NULL)
+        return;
+    pthread_mutex_destroy(&w->lock);
+    pthread_cond_destroy(&w->wake);
+    free(w->candidates);
+    free(w->dirty);
+    free(w);
+}
+
+//Allocates the background writer of a pool of numPages frames, NULL if memory runs out.
+//The thread is started once the pool is ready.
+static BackgroundWriter *writerCreate(int numPages, const BM_PoolOptions *options) {
+    BackgroundWriter *w = calloc(1, sizeof(BackgroundWriter));
+
+    if (w == NULL)
+        return NULL;
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->wake, NULL);
+    w->delay = options->bgWriterDelay > 0 ? options->bgWriterDelay : 1;
+    w->maxPages = options->bgWriterMaxPages < 1 ? 1
+                  : (options->bgWriterMaxPages > numPages ? numPages : options->bgWriterMaxPages);
+    w->watermark = (int)((long)numPages * options->dirtyWatermark / 100);
+    if (w->watermark < 1)
+        w->watermark = 1;
+    w->lookahead = numPages / BGWRITER_LOOKAHEAD > w->maxPages ? numPages / BGWRITER_LOOKAHEAD : w->maxPages;
+    w->candidates = malloc(sizeof(int) * w->lookahead);
+    w->dirty = malloc(sizeof(FlushEntry) * w->maxPages);
+    if (w->candidates == NULL || w->dirty == NULL) {
+        writerFree(w);
+        return NULL;
+    }
+    return w;
+}
+
+//One round of the background writer: writes the dirty unpinned pages among the next victims
+static void writerRound(BM_BufferPool *const bm) {
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bm->mgmtData;
+    BackgroundWriter *w = mgmt->writer;
+    PageFrame *frame;
+    int i, n, numDirty = 0;
+
+    lockPolicy(mgmt);
+    if (mgmt->policy->nextVictims != NULL) {
+        n = mgmt->policy->nextVictims(mgmt->policyState, bm, w->candidates, w->lookahead);
+    } else {
+        for (n = 0; n < w->lookahead; n++) {
+            w->candidates[n] = w->hand;
+            w->hand = (w->hand + 1) % bm->numPages;
+        }
+    }
+    //Frames only get another page under policyLock, so the page seen here is the one to write
+    for (i = 0; i < n && numDirty < w->maxPages; i++) {
+        frame = &mgmt->frames[w->candidates[i]];
+        if (frame->pageNum != NO_PAGE && frame->fixCount == 0 && frame->dirtyBit == 1) {
+            w->dirty[numDirty].pageNum = frame->pageNum;
+            w->dirty[numDirty].frame = w->candidates[i];
+            numDirty++;
+        }
+    }
+    unlockPolicy(mgmt);
+    flushEntries(bm, w->dirty, numDirty);
+}
+
+//Thread of the background writer, bm is the writer's copy of the pool handle
+static void *writerMain(void *arg) {
+    BM_BufferPool *bm = arg;
+    BackgroundWriter *w = ((BM_PoolMgmt *)bm->mgmtData)->writer;
+    struct timespec until;
+
+    pthread_mutex_lock(&w->lock);
+    while (!w->stop) {
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_sec += w->delay / 1000;
+        until.tv_nsec += (long)(w->delay % 1000) * 1000000;
+        if (until.tv_nsec >= 1000000000) {
+            until.tv_sec++;
+            until.tv_nsec -= 1000000000;
         }
+        pthread_cond_timedwait(&w->wake, &w->lock, &until);
+        if (!w->stop)
+            writerRound(bm);
     }
+    pthread_mutex_unlock(&w->lock);
+    return NULL;
+}
+
+//Stops the background writer after the round it is in, before the pool is torn down
+static void writerStop(BackgroundWriter *w) {
+    pthread_mutex_lock(&w->lock);
+    w->stop = true;
+    pthread_cond_signal(&w->wake);
+    pthread_mutex_unlock(&w->lock);
+    pthread_join(w->thread, NULL);
 }
 
 // Work done by Rudra Patel A20594446
 
+//Fills a BM_PoolOptions with the defaults used by initBufferPool
+extern void initPoolOptions(BM_PoolOptions *const options) {
+    options->concurrent = false;
+    options->numPartitions = DEFAULT_PARTITIONS;
+    options->hugePages = false;
+    options->numaNode = -1;
+    options->directIO = false;
+    options->ioEngine = IO_ENGINE_AUTO;
+    options->mmapPages = false;
+    options->admissionFilter = false;
+    options->scanRingSize = MIN_SCAN_RING;
+    options->readAhead = false;
+    options->prefetcher = false;
+    options->prefetchBudget = DEFAULT_PREFETCH_BUDGET;
+    options->backgroundWriter = false;
+    options->bgWriterDelay = DEFAULT_BGWRITER_DELAY;
+    options->bgWriterMaxPages = DEFAULT_BGWRITER_MAX_PAGES;
+    options->dirtyWatermark = DEFAULT_DIRTY_WATERMARK;
+}
+
+//Frees what initBufferPool allocated besides the page tables and latches: the I/O
+//engine, the page file handle and its mapping, the page memory and the frame arrays
+static void releasePool(BM_PoolMgmt *mgmt) {
+    if (mgmt->io != NULL)
+        shutdownIOEngine(mgmt->io);
+    if (mgmt->map != NULL) {
+        munmap(mgmt->map, mgmt->mapReserved);
+        pthread_mutex_destroy(&mgmt->mapLock);
+    }
+    closePageFile(&mgmt->fh);
+    freeArena(mgmt);
+    if (mgmt->policy != NULL && mgmt->policy->shutdown != NULL && mgmt->policyState != NULL)
+        mgmt->policy->shutdown(mgmt->policyState);
+    admissionFree(mgmt->admission);
+    prefetcherFree(mgmt->prefetcher);
+    writerFree(mgmt->writer);
+    free(mgmt->ring);
+    free(mgmt->ringPages);
+    free(mgmt->ioRequests);
+    free(mgmt->frames);
+    free(mgmt->partitions);
+    free(mgmt->latches);
+    free(mgmt);
+}
+
 /*
  * Initializes a buffer pool with the specified parameters.
  *
@@ -231,30 +2345,177 @@ extern void CLOCK(BM_BufferPool *const bm, PageFrame *page) {
  * - RC_OK if the buffer pool is successfully initialized, otherwise an error code.
  */
 extern RC initBufferPool(BM_BufferPool *const bm, const char *const pageFileName, const int numPages, ReplacementStrategy strategy,void *stratData) {
+    return initBufferPoolWithOptions(bm, pageFileName, numPages, strategy, stratData, NULL);
+}
+
+/*
+ * Initializes a buffer pool like initBufferPool, with extra pool settings.
+ *
+ * Parameters:
+ * - options: Pool settings filled by initPoolOptions, NULL for the defaults.
+ *   With options->concurrent the pool may be used from several threads: the page
+ *   table is split into lock striped partitions, each frame gets its own latch and
+ *   fix counts are atomic. options->hugePages and options->numaNode choose how the
+ *   frame memory is backed and where it is placed. options->directIO reads and
+ *   writes the page file with O_DIRECT, so pages are not cached twice.
+ *   options->mmapPages maps the page file instead of reading it into frames, see
+ *   the README. Direct I/O, huge pages and NUMA placement do not apply to it.
+ *   options->backgroundWriter starts a thread that writes dirty pages back before
+ *   they are replaced, and latches the pool like options->concurrent.
+ *
+ * Returns:
+ * - RC_OK if the buffer pool is successfully initialized, otherwise an error code.
+ */
+extern RC initBufferPoolWithOptions(BM_BufferPool *const bm, const char *const pageFileName, const int numPages, ReplacementStrategy strategy, void *stratData, const BM_PoolOptions *const options) {
+    BM_PoolOptions defaults;
+    BM_PoolMgmt *mgmt;
+    int i, numPartitions = 1, numFrames, ringBytes;
+    bool admission, concurrent;
+    RC rc;
+
+    bm->mgmtData = NULL;
+    if (numPages <= 0)
+        return RC_BP_INIT_ERROR;
+    if (options == NULL) {
+        initPoolOptions(&defaults);
+        return initBufferPoolWithOptions(bm, pageFileName, numPages, strategy, stratData, &defaults);
+    }
+
     bm->pageFile = (char *)pageFileName;
     //Set the number of pages that buffer pool will manage
     bm->numPages = numPages;
     //Setting the replacement stratergy to stratergy argument
     bm->strategy = strategy;
 
-    PageFrame *page = malloc(sizeof(PageFrame) * numPages);
-
-    //Initialize the buffer size to the number of pages
-    buffer_size = numPages;
-    int i;
+    //The filter needs frames to read pages it turns away into, an mmap pool has none
+    admission = options->admissionFilter && !options->mmapPages;
+    numFrames = admission ? numPages + 1 : numPages;
+    //The background writer works next to the clients, so its pool is latched like a concurrent one
+    concurrent = options->concurrent || options->backgroundWriter;
+
+    //A pool used by one thread keeps a single page table and no latches
+    if (options->concurrent)
+        while (numPartitions < options->numPartitions)
+            numPartitions <<= 1;
+
+    mgmt = calloc(1, sizeof(BM_PoolMgmt));
+    if (mgmt == NULL)
+        return RC_BP_INIT_ERROR;
+    //Open the page file once, every read and write of the pool goes through this handle.
+    //Frames are FRAME_ALIGNMENT aligned, so direct I/O moves them without a bounce copy.
+    if (options->directIO && !options->mmapPages)
+        rc = openPageFileDirect((char *)pageFileName, &mgmt->fh);
+    else
+        rc = openPageFile((char *)pageFileName, &mgmt->fh);
+    if (rc != RC_OK) {
+        free(mgmt);
+        return rc;
+    }
+    mgmt->ioRequests = calloc(numFrames, sizeof(IO_Request));
+    mgmt->frames = calloc(numFrames, sizeof(PageFrame));
+    mgmt->partitions = calloc(numPartitions, sizeof(PagePartition));
+    if (concurrent)
+        mgmt->latches = malloc(sizeof(FrameLatch) * numFrames);
+    if (admission)
+        mgmt->admission = admissionCreate(numPages);
+    //Like read-ahead, the prefetcher is left to the kernel in an mmap pool
+    if (options->prefetcher && !options->mmapPages)
+        mgmt->prefetcher = prefetcherCreate(numPages, mgmt->fh.totalNumPages, options->prefetchBudget);
+    if (options->backgroundWriter)
+        mgmt->writer = writerCreate(numPages, options);
+    //The sequential ring, clamped to its bounds and to an eighth of the pool
+    ringBytes = options->scanRingSize < MIN_SCAN_RING ? MIN_SCAN_RING
+                : (options->scanRingSize > MAX_SCAN_RING ? MAX_SCAN_RING : options->scanRingSize);
+    mgmt->ringSize = ringBytes / PAGE_SIZE < numPages / 8 ? ringBytes / PAGE_SIZE : numPages / 8;
+    if (mgmt->ringSize < 1)
+        mgmt->ringSize = 1;
+    mgmt->ring = malloc(sizeof(int) * mgmt->ringSize);
+    mgmt->ringPages = malloc(sizeof(PageNumber) * mgmt->ringSize);
+    //The strategy keeps its state per pool, a custom one comes in stratData with its own params
+    if (strategy >= RS_FIFO && strategy < RS_CUSTOM)
+        mgmt->policy = &builtinPolicies[strategy];
+    else if (strategy == RS_CUSTOM && stratData != NULL && ((BM_ReplacementPolicy *)stratData)->pickVictim != NULL)
+        mgmt->policy = stratData;
+    if (mgmt->policy != NULL) {
+        if (strategy == RS_CUSTOM)
+            stratData = mgmt->policy->params;
+        mgmt->policyState = (mgmt->policy->init != NULL) ? mgmt->policy->init(numPages, stratData) : stratData;
+    }
+    if (options->mmapPages) {
+        //Frames of an mmap pool point into the mapping, there is no page memory to allocate
+        //and the kernel moves the pages, so no I/O engine is needed either
+        if (mapPageFile(mgmt) != RC_OK)
+            mgmt->map = NULL;
+    } else {
+        //Reads and flushes are queued on an I/O engine: io_uring, or worker threads where it is missing
+        if (initIOEngine(&mgmt->io, &mgmt->fh, options->ioEngine, IO_QUEUE_DEPTH) != RC_OK)
+            mgmt->io = NULL;
+        //All page memory is carved out of one aligned block up front and reused in place on
+        //eviction, so the miss path never allocates and the frames are usable for direct I/O
+        if (allocArena(mgmt, numFrames, options) != RC_OK)
+            mgmt->arena = NULL;
+    }
+    if (mgmt->ioRequests == NULL || mgmt->frames == NULL || mgmt->partitions == NULL
+        || mgmt->ring == NULL || mgmt->ringPages == NULL
+        || (options->prefetcher && !options->mmapPages && mgmt->prefetcher == NULL)
+        || (options->mmapPages ? mgmt->map == NULL : (mgmt->io == NULL || mgmt->arena == NULL))
+        || (options->backgroundWriter && mgmt->writer == NULL)
+        || (concurrent && mgmt->latches == NULL) || mgmt->policy == NULL
+        || (mgmt->policy->init != NULL && mgmt->policyState == NULL) || (admission && mgmt->admission == NULL)) {
+        releasePool(mgmt);
+        return RC_BP_INIT_ERROR;
+    }
 
-    for (i = 0; i < buffer_size; i++) {
-        page[i].data = NULL;
-        page[i].pageNum = -1;
-        page[i].dirtyBit = 0;
-        page[i].fixCount = 0;
-        page[i].hitNum = 0;
-        page[i].refNum = 0;
+    mgmt->numPartitions = numPartitions;
+    mgmt->concurrent = concurrent;
+    mgmt->bypass = admission ? numPages : -1;
+    //The kernel reads ahead for an mmap pool
+    mgmt->readAhead = options->readAhead && !options->mmapPages;
+    mgmt->streamNext = NO_PAGE;
+    for (i = 0; i < mgmt->ringSize; i++)
+        mgmt->ring[i] = -1;
+    for (i = 0; i < numPartitions; i++) {
+        //Size every partition for its even share of the pool, they grow if pages cluster
+        if (pageTableInit(&mgmt->partitions[i].table, (numPages + numPartitions - 1) / numPartitions) != RC_OK) {
+            while (--i >= 0)
+                pageTableFree(&mgmt->partitions[i].table);
+            releasePool(mgmt);
+            return RC_BP_INIT_ERROR;
+        }
+        if (mgmt->concurrent)
+            pthread_mutex_init(&mgmt->partitions[i].lock, NULL);
     }
 
-    //Storing the page frame array to buffer pool's management data
-    bm->mgmtData = page;
-    track_write_count = clock_pointer = lfu_pointer = 0;
+    for (i = 0; i < numFrames; i++) {
+        mgmt->frames[i].data = (mgmt->map != NULL) ? NULL : mgmt->arena + (size_t)i * PAGE_SIZE;
+        mgmt->frames[i].pageNum = NO_PAGE;
+        mgmt->frames[i].dirtyBit = 0;
+        mgmt->frames[i].fixCount = 0;
+        mgmt->frames[i].ioInProgress = 0;
+        mgmt->frames[i].writeInProgress = 0;
+        mgmt->frames[i].ioError = 0;
+        mgmt->frames[i].version = 0;
+        if (mgmt->concurrent) {
+            pthread_mutex_init(&mgmt->latches[i].mutex, NULL);
+            pthread_cond_init(&mgmt->latches[i].ioDone, NULL);
+            pthread_rwlock_init(&mgmt->latches[i].content, NULL);
+        }
+    }
+    if (mgmt->concurrent)
+        pthread_mutex_init(&mgmt->policyLock, NULL);
+
+    //Every counter lives here, so pools opened side by side never share state
+    bm->mgmtData = mgmt;
+    if (mgmt->writer != NULL) {
+        mgmt->writer->pool = *bm;
+        if (pthread_create(&mgmt->writer->thread, NULL, writerMain, &mgmt->writer->pool) != 0) {
+            //Without its thread the pool is closed again like any other
+            writerFree(mgmt->writer);
+            mgmt->writer = NULL;
+            shutdownBufferPool(bm);
+            return RC_BP_INIT_ERROR;
+        }
+    }
     return RC_OK;
 }
 
@@ -268,32 +2529,46 @@ extern RC initBufferPool(BM_BufferPool *const bm, const char *const pageFileName
  * - RC_OK if all dirty pages are successfully written to disk, otherwise an error code.
  */
 extern RC forceFlushPool(BM_BufferPool *const bm) {
-    PageFrame *pageFrame = (PageFrame *)bm->mgmtData;
-    int i;
-
-    for (i = 0; i < buffer_size; i++) {
-        //If page is not pinned, and dirty, then the paeg file can write dirty page back to disk
-        if (pageFrame[i].fixCount == 0 && pageFrame[i].dirtyBit == 1) {
-            SM_FileHandle fh;
-
-            //Open the page file to write the dirty page
-            openPageFile(bm->pageFile, &fh);
-
-            //Now write the page back to disk
-            writeBlock(pageFrame[i].pageNum, &fh, pageFrame[i].data);
-            pageFrame[i].dirtyBit = 0;
-
-            //Incrementing the writing count to track the pages written to disk
-            track_write_count++;
-        }
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bm->mgmtData;
+    PageFrame *pageFrame;
+    FlushEntry *dirty;
+    int i, numDirty = 0;
+    RC rc;
+
+    if (mgmt == NULL)
+        return RC_BP_NOT_INITIALIZED;
+    pageFrame = mgmt->frames;
+    dirty = malloc(sizeof(FlushEntry) * bm->numPages);
+    if (dirty == NULL)
+        return RC_BP_FLUSHPOOL_FAILED;
+
+    //A round of the background writer finishes first, pages it has pinned would be skipped.
+    //Frames only get another page under policyLock, so the pages seen are the ones to write.
+    if (mgmt->writer != NULL)
+        pthread_mutex_lock(&mgmt->writer->lock);
+    lockPolicy(mgmt);
+    for (i = 0; i < bm->numPages; i++) {
+        PageNumber pageNum = pageFrame[i].pageNum;
+
+        //If page is not pinned, and dirty, then the page file can write dirty page back to disk
+        if (pageNum == NO_PAGE || pageFrame[i].fixCount != 0 || pageFrame[i].dirtyBit != 1)
+            continue;
+        dirty[numDirty].pageNum = pageNum;
+        dirty[numDirty].frame = i;
+        numDirty++;
     }
-    return RC_OK;
+    unlockPolicy(mgmt);
+    rc = flushEntries(bm, dirty, numDirty);
+    if (mgmt->writer != NULL)
+        pthread_mutex_unlock(&mgmt->writer->lock);
+    free(dirty);
+    return rc;
 }
 
 /*
  * Destroys a buffer pool, freeing up all associated resources.
- * If the buffer pool contains any dirty pages with a fix count of 0,
- * they are written back to disk before destroying the pool.
+ * If the buffer pool contains any dirty pages, they are written back to disk
+ * before destroying the pool, including pages that clients still have pinned.
  *
  * Parameters:
  * - bm: Pointer to the buffer pool structure to be shut down.
@@ -302,201 +2577,728 @@ extern RC forceFlushPool(BM_BufferPool *const bm) {
  * - RC_OK if the buffer pool is successfully shut down, otherwise an error code.
  */
 extern RC shutdownBufferPool(BM_BufferPool *const bm) {
-    PageFrame *pageFrame = (PageFrame *)bm->mgmtData;
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bm->mgmtData;
+    PageFrame *pageFrame;
+    int i, numFrames;
+
+    if (mgmt == NULL)
+        return RC_BP_NOT_INITIALIZED;
+    pageFrame = mgmt->frames;
+    //The bypass frame of a pool with an admission filter follows the numPages frames
+    numFrames = (mgmt->bypass >= 0) ? bm->numPages + 1 : bm->numPages;
+    if (mgmt->writer != NULL)
+        writerStop(mgmt->writer);
     //Call the function to write any dirty pages
     forceFlushPool(bm);
-    int i;
-   
-    for (i = 0; i < buffer_size; i++) {
-        if (pageFrame[i].fixCount != 0) {
-            // Return an error indicating that pinned pages are still in the buffer
-            return RC_PINNED_PAGES_IN_BUFFER;
+
+    //Pages still pinned do not keep the pool alive, their handles become invalid.
+    //forceFlushPool skips them, so their changes are written here.
+    for (i = 0; i < numFrames; i++) {
+        if (pageFrame[i].pageNum != NO_PAGE && pageFrame[i].fixCount != 0 && pageFrame[i].dirtyBit == 1)
+            writeFrame(bm, i);
+    }
+
+    //Pages read ahead that nobody pinned may still be on their way in, and their
+    //completions use the latches
+    if (mgmt->io != NULL)
+        waitAllIO(mgmt->io);
+
+    //Free the page memory, the page frames, the page table and the latches
+    if (mgmt->concurrent) {
+        for (i = 0; i < numFrames; i++) {
+            pthread_mutex_destroy(&mgmt->latches[i].mutex);
+            pthread_cond_destroy(&mgmt->latches[i].ioDone);
+            pthread_rwlock_destroy(&mgmt->latches[i].content);
         }
     }
-    //Free the memory allocated for the page frames
-    free(pageFrame);
+    for (i = 0; i < mgmt->numPartitions; i++) {
+        pageTableFree(&mgmt->partitions[i].table);
+        if (mgmt->concurrent)
+            pthread_mutex_destroy(&mgmt->partitions[i].lock);
+    }
+    if (mgmt->concurrent)
+        pthread_mutex_destroy(&mgmt->policyLock);
+    releasePool(mgmt);
     //Setting the management data of Buffer manager to NULL as it is no longer in use
     bm->mgmtData = NULL;
     return RC_OK;
 }
 
-//The markDirty function traverses the buffer pool to find the page with a matching page number
+//The markDirty function looks up the frame holding the page and sets its dirty bit
 extern RC markDirty(BM_BufferPool *const bm, BM_PageHandle *const page) {
-    //Retrieve the page frame array
-    PageFrame *pageFrame = (PageFrame *)bm->mgmtData;
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bm->mgmtData;
+    PagePartition *part;
     int i;
-   
-    for (i = 0; i < buffer_size; i++) {
-        //Check if the current page number matches that page to be marked dirty
-        if (pageFrame[i].pageNum == page->pageNum) {
-            // To represent the page has been modified, set the dirty bit to 1
-            pageFrame[i].dirtyBit = 1;
-            return RC_OK;
-        }
+
+    if (mgmt == NULL)
+        return RC_BP_NOT_INITIALIZED;
+    if (isBypassed(mgmt, page)) {
+        lockFrame(mgmt, mgmt->bypass);
+        setDirty(mgmt, mgmt->bypass, 1);
+        unlockFrame(mgmt, mgmt->bypass);
+        return RC_OK;
+    }
+    //Find the frame holding the page through the page table
+    part = partitionOf(mgmt, page->pageNum);
+    lockPartition(mgmt, part);
+    i = pageTableLookup(&part->table, page->pageNum);
+    if (i >= 0) {
+        // To represent the page has been modified, set the dirty bit to 1
+        lockFrame(mgmt, i);
+        setDirty(mgmt, i, 1);
+        unlockFrame(mgmt, i);
+        //Plain pins write without a latch, so fail optimistic reads that overlapped the change
+        mgmt->frames[i].version += 2;
     }
-    return RC_ERROR;
+    unlockPartition(mgmt, part);
+    return (i >= 0) ? RC_OK : RC_ERROR;
 }
 
-// unpinpage function decreases the fix count of the page once it's no longer needed 
+// unpinpage function decreases the fix count of the page once it's no longer needed
 // This allows the page to be considered for replacement when the fix count reaches zero.
 extern RC unpinPage(BM_BufferPool *const bm, BM_PageHandle *const page) {
-    PageFrame *pageFrame = (PageFrame *)bm->mgmtData;
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bm->mgmtData;
+    PagePartition *part;
     int i;
-   
-    for (i = 0; i < buffer_size; i++) {
-        //Check if the current page number matches the page tp be unpinned
-        if (pageFrame[i].pageNum == page->pageNum) {
-            //Decrement the fix count to indicate that this page is no longer pinned
-            pageFrame[i].fixCount--;
-            break;
-        }
+
+    if (mgmt == NULL)
+        return RC_BP_NOT_INITIALIZED;
+    if (isBypassed(mgmt, page))
+        return unpinBypass(bm);
+    //Find the frame holding the page to be unpinned
+    part = partitionOf(mgmt, page->pageNum);
+    lockPartition(mgmt, part);
+    i = pageTableLookup(&part->table, page->pageNum);
+    if (i >= 0 && mgmt->frames[i].fixCount > 0) {
+        //Decrement the fix count to indicate that this page is no longer pinned
+        if (--mgmt->frames[i].fixCount == 0)
+            policyOnUnpin(bm, i);
     }
-    return RC_OK;
+    unlockPartition(mgmt, part);
+    return (i >= 0) ? RC_OK : RC_ERROR;
 }
 
 // ForcePage function writes a specific page into memory
 // it ensures the data in the buffer pool for the page is saved to disk.
 extern RC forcePage(BM_BufferPool *const bm, BM_PageHandle *const page) {
-    PageFrame *pageFrame = (PageFrame *)bm->mgmtData;
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bm->mgmtData;
+    PagePartition *part;
+    RC rc = RC_OK;
     int i;
 
-    for (i = 0; i < buffer_size; i++) {
-        // Check if current page number matches the page to be forced to disk
-        if (pageFrame[i].pageNum == page->pageNum) {
-            SM_FileHandle fh;
-            openPageFile(bm->pageFile, &fh); // Open the page file for writing
-                        
-            // Write the current page's data back to disk
-            writeBlock(pageFrame[i].pageNum, &fh, pageFrame[i].data);
-            
-            // Mark the page as clean by resetting the dirty bit
-            pageFrame[i].dirtyBit = 0;
-            track_write_count++;  // Increment the write count for statistics
+    if (mgmt == NULL)
+        return RC_BP_NOT_INITIALIZED;
+    //The caller's pin keeps the bypass frame's page in place
+    if (isBypassed(mgmt, page))
+        return writeFrame(bm, mgmt->bypass);
+    // Find the frame holding the page to be forced to disk and pin it during the write
+    part = partitionOf(mgmt, page->pageNum);
+    lockPartition(mgmt, part);
+    i = pageTableLookup(&part->table, page->pageNum);
+    if (i >= 0)
+        mgmt->frames[i].fixCount++;
+    unlockPartition(mgmt, part);
+
+    if (i < 0)
+        return RC_ERROR;
+    // Write the current page's data back to disk, this also resets the dirty bit
+    rc = writeFrame(bm, i);
+    mgmt->frames[i].fixCount--;
+    return rc;
+}
+
+//Read-ahead
+// A pool with BM_PoolOptions.readAhead watches the pages its misses and read ahead hits
+// ask for. Once one follows the page before it, the next pages are read into frames in
+// the background, and the window of pages kept ahead of the stream doubles with every
+// further step, up to READAHEAD_MAX. A pin elsewhere ends the stream.
+
+//Claims a frame for pageNum and starts reading it, with nobody pinning it. Only an empty
+//frame or a clean unpinned victim is taken: false if there is none, and read-ahead stops.
+//kind tells how the page is read ahead, a speculative read also needs a prefetcher credit.
+static bool prefetchPage(BM_BufferPool *const bm, PageNumber pageNum, BM_AccessHint hint, unsigned char kind) {
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bm->mgmtData;
+    PagePartition *part = partitionOf(mgmt, pageNum), *victimPart;
+    PageFrame *frame;
+    bool evicted, fromRing, taken;
+    int i;
+
+    lockPartition(mgmt, part);
+    if (pageTableLookup(&part->table, pageNum) >= 0) {
+        unlockPartition(mgmt, part);
+        return true;
+    }
+    lockPolicy(mgmt);
+    //A page the admission filter turned away is already in the bypass frame, a second copy
+    //would go stale as soon as its holder changes it
+    if (mgmt->admission != NULL && mgmt->frames[mgmt->bypass].pageNum == pageNum) {
+        unlockPolicy(mgmt);
+        unlockPartition(mgmt, part);
+        return true;
+    }
+    if (kind == PREFETCH_SPECULATIVE && mgmt->prefetcher->credit <= 0) {
+        unlockPolicy(mgmt);
+        unlockPartition(mgmt, part);
+        return false;
+    }
+    i = (hint == BM_ACCESS_SEQUENTIAL) ? ringVictim(mgmt) : -1;
+    fromRing = i >= 0;
+    evicted = fromRing || mgmt->usedFrames == bm->numPages;
+    if (!fromRing)
+        i = evicted ? pickVictim(bm, pageNum) : mgmt->usedFrames;
+    taken = i >= 0;
+    frame = taken ? &mgmt->frames[i] : NULL;
+
+    //Read-ahead never waits, a victim that is busy or needs a write back ends it. With
+    //an admission filter only a victim used less than the new page gives way.
+    if (taken && evicted && frame->pageNum != NO_PAGE) {
+        victimPart = partitionOf(mgmt, frame->pageNum);
+        taken = (victimPart == part || tryLockPartition(mgmt, victimPart));
+        if (taken) {
+            taken = frame->fixCount == 0 && frame->dirtyBit == 0
+                    && (fromRing || mgmt->admission == NULL || admitPage(mgmt, pageNum, frame->pageNum));
+            if (taken) {
+                pageTableRemove(&victimPart->table, frame->pageNum);
+                if (frame->prefetched)
+                    mgmt->prefetchWasted++;
+                policyOnEvict(bm, i);
+            }
+            if (victimPart != part)
+                unlockPartition(mgmt, victimPart);
+        }
+    }
+
+    if (taken) {
+        if (!evicted)
+            mgmt->usedFrames++;
+        frame->pageNum = pageNum;
+        setDirty(mgmt, i, 0);
+        frame->ioError = 0;
+        frame->ioInProgress = 1;
+        frame->prefetched = kind;
+        frame->version++;
+        if (kind == PREFETCH_SPECULATIVE)
+            mgmt->prefetcher->credit--;
+        pageTableInsert(&part->table, pageNum, i);
+        //Nobody holds the page, it can be replaced as soon as it has arrived
+        policyOnLoad(bm, i);
+        if (mgmt->policy->onUnpin != NULL)
+            mgmt->policy->onUnpin(mgmt->policyState, i);
+        if (hint == BM_ACCESS_SEQUENTIAL)
+            ringRecord(mgmt, i, pageNum);
+        //The read is started before the page can be found, so whoever pins it can wait for it
+        startFrameRead(mgmt, i, pageNum);
+    }
+    unlockPolicy(mgmt);
+    unlockPartition(mgmt, part);
+    return taken;
+}
+
+//Follows the stream with pageNum, which a miss has just read or a pin found read ahead,
+//and reads ahead if the stream got within half a window of the pages read ahead so far
+static void readAhead(BM_BufferPool *const bm, PageNumber pageNum, BM_AccessHint hint) {
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bm->mgmtData;
+    PageNumber from = 0, to = 0;
+    int limit;
+
+    if (!mgmt->readAhead)
+        return;
+    //A scan keeps its pages in the ring, so it reads ahead no further than half the ring.
+    //Other streams take up to a quarter of the pool.
+    limit = (hint == BM_ACCESS_SEQUENTIAL) ? mgmt->ringSize / 2 : bm->numPages / 4;
+    if (limit > READAHEAD_MAX)
+        limit = READAHEAD_MAX;
+
+    lockPolicy(mgmt);
+    if (pageNum == mgmt->streamNext && limit > 0) {
+        mgmt->raWindow = (mgmt->raWindow == 0) ? READAHEAD_MIN : 2 * mgmt->raWindow;
+        if (mgmt->raWindow > limit)
+            mgmt->raWindow = limit;
+    } else {
+        mgmt->raWindow = 0;
+        mgmt->raEnd = pageNum + 1;
+    }
+    mgmt->streamNext = pageNum + 1;
+    if (mgmt->raEnd < pageNum + 1)
+        mgmt->raEnd = pageNum + 1;
+    if (mgmt->raWindow > 0 && mgmt->raEnd - pageNum <= (mgmt->raWindow + 1) / 2) {
+        from = mgmt->raEnd;
+        //Pages past the end of the file are not read ahead, that would grow the file
+        to = pageNum + 1 + mgmt->raWindow;
+        if (to > mgmt->fh.totalNumPages)
+            to = mgmt->fh.totalNumPages;
+        if (to > from)
+            mgmt->raEnd = to;
+    }
+    unlockPolicy(mgmt);
+
+    //Pages read ahead for nothing hold their frames until their reads are completed
+    if (from < to)
+        pollIO(mgmt->io);
+    for (; from < to; from++)
+        if (!prefetchPage(bm, from, hint, PREFETCH_READAHEAD))
+            break;
+    //io_uring only passes the reads to the kernel when asked
+    submitIO(mgmt->io);
+}
+
+//Learns from pageNum, which a miss has just read or a pin found read ahead, and loads
+//the pages predicted to follow. refund tells whether the prefetcher itself read it.
+static void speculate(BM_BufferPool *const bm, PageNumber pageNum, bool refund) {
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bm->mgmtData;
+    Prefetcher *pf = mgmt->prefetcher;
+    PageNumber predicted[STRIDE_DEGREE + MARKOV_WAYS];
+    Successors *e;
+    int numPredicted = 0, numStride, stride, ahead, j;
+
+    if (pf == NULL)
+        return;
+    lockPolicy(mgmt);
+    if (refund && pf->credit < pf->budget)
+        pf->credit++;
+    if (++pf->observed % PREFETCH_REFILL == 0 && pf->credit < pf->budget)
+        pf->credit++;
+
+    if (pf->last != NO_PAGE && pf->last != pageNum) {
+        stride = pageNum - pf->last;
+        if (stride == pf->stride) {
+            pf->strideRepeats++;
+        } else {
+            pf->strideRepeats = 1;
+            pf->strideEnd = pageNum;
         }
+        pf->stride = stride;
+        learnSuccessor(pf, pf->last, pageNum);
+    }
+    pf->last = pageNum;
+
+    //Pages up to strideEnd are loaded already and are not looked up again. The next ones
+    //follow once half of them are used, so each submission carries several reads.
+    stride = pf->stride;
+    if (pf->strideRepeats >= STRIDE_CONFIDENCE) {
+        ahead = (pf->strideEnd - pageNum) / stride;
+        if (ahead <= pf->degree / 2)
+            for (j = (ahead > 0) ? ahead + 1 : 1; j <= pf->degree; j++)
+                predicted[numPredicted++] = pageNum + j * stride;
+    }
+    numStride = numPredicted;
+    e = successorsOf(pf, pageNum, false);
+    if (e != NULL)
+        for (j = 0; j < MARKOV_WAYS; j++)
+            if (e->count[j] >= MARKOV_CONFIDENCE)
+                predicted[numPredicted++] = e->next[j];
+    unlockPolicy(mgmt);
+
+    //Pages past the end of the file are not loaded, that would grow the file
+    for (j = 0; j < numPredicted; j++)
+        if (predicted[j] >= 0 && predicted[j] < mgmt->fh.totalNumPages
+            && !prefetchPage(bm, predicted[j], BM_ACCESS_NORMAL, PREFETCH_SPECULATIVE))
+            break;
+    if (numPredicted > 0)
+        submitIO(mgmt->io);
+    //Only the pages that could be loaded count, the others are tried again with the next pin
+    if (j > numStride)
+        j = numStride;
+    if (j > 0) {
+        lockPolicy(mgmt);
+        if (pf->stride == stride)
+            pf->strideEnd = predicted[j - 1];
+        unlockPolicy(mgmt);
     }
-    return RC_OK;
 }
 
 //pinPage function pins a page with the given page number into the buffer pool
 extern RC pinPage(BM_BufferPool *const bm, BM_PageHandle *const page, const PageNumber pageNum) {
-    PageFrame *pageFrame = (PageFrame *)bm->mgmtData;
-    // Check if the first page frame is empty
-    if (pageFrame[0].pageNum == -1) {
-        SM_FileHandle fh;
-        openPageFile(bm->pageFile, &fh);
-        pageFrame[0].data = (SM_PageHandle) malloc(PAGE_SIZE);
-        ensureCapacity(pageNum, &fh);
-        readBlock(pageNum, &fh, pageFrame[0].data);
-        pageFrame[0].pageNum = pageNum;
-        pageFrame[0].fixCount++;
-        last_index_bp = hit = 0;
-        pageFrame[0].hitNum = hit;
-        pageFrame[0].refNum = 0;
-        page->pageNum = pageNum;
-        page->data = pageFrame[0].data;
-        return RC_OK;
-    } else {
-        int i;
-        bool isBufferFull = true;
-       
-       // Check if the requested page is already in the buffer
-        for (i = 0; i < buffer_size; i++) {
-            if (pageFrame[i].pageNum != -1) {
-                if (pageFrame[i].pageNum == pageNum) {
-                    pageFrame[i].fixCount++;
-                    isBufferFull = false;
-                    hit++;
-
-                    // Update hit number based on replacement strategy
-                    if (bm->strategy == RS_LRU)
-                        pageFrame[i].hitNum = hit;
-                    else if (bm->strategy == RS_CLOCK)
-                        pageFrame[i].hitNum = 1;
-                    else if (bm->strategy == RS_LFU)
-                        pageFrame[i].refNum++;
-
-                    page->pageNum = pageNum;
-                    page->data = pageFrame[i].data;
-                    clock_pointer++;
-                    break;
+    return pinPageWithHint(bm, page, pageNum, BM_ACCESS_NORMAL);
+}
+
+//pinPageWithHint pins a page like pinPage, telling the pool how the caller goes through pages.
+//A hit only holds the page's partition lock. A miss claims a frame under the
+//partition and policy locks, then reads the page with no pool lock held; other
+//clients asking for the same page meanwhile wait on the frame latch.
+//A sequential miss recycles the frames of the pool's scan ring rather than asking the
+//replacement strategy, so a scan replaces its own pages and not the working set.
+extern RC pinPageWithHint(BM_BufferPool *const bm, BM_PageHandle *const page, const PageNumber pageNum, BM_AccessHint hint) {
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bm->mgmtData;
+    PagePartition *part, *victimPart;
+    PageFrame *frame;
+    bool evicted, dirtyVictim, redirtied, bypassed = false, recorded = false, fromRing, drained = false;
+    unsigned char prefetched;
+    RC rc;
+    int i;
+
+    if (mgmt == NULL)
+        return RC_BP_NOT_INITIALIZED;
+    if (pageNum < 0)
+        return RC_READ_NON_EXISTING_PAGE;
+    part = partitionOf(mgmt, pageNum);
+
+    while (1) {
+        //Prefetched pages nobody pinned yet count as pinned until their read is completed.
+        //On io_uring that only happens when some thread reaps it, so do it before picking a victim.
+        if (mgmt->io != NULL)
+            pollIO(mgmt->io);
+
+        // Check if the requested page is already in the buffer
+        lockPartition(mgmt, part);
+        i = pageTableLookup(&part->table, pageNum);
+        if (i >= 0) {
+            mgmt->frames[i].fixCount++;
+            prefetched = mgmt->frames[i].prefetched;
+            mgmt->frames[i].prefetched = PREFETCH_NONE;
+            unlockPartition(mgmt, part);
+
+            //The pages expected next are queued before waiting, so their reads overlap this one
+            if (prefetched != PREFETCH_NONE) {
+                readAhead(bm, pageNum, hint);
+                if (hint == BM_ACCESS_NORMAL)
+                    speculate(bm, pageNum, prefetched == PREFETCH_SPECULATIVE);
+            }
+
+            // The page may still be on its way in from disk for another client
+            rc = waitForFrame(mgmt, i, prefetched != PREFETCH_NONE);
+            if (rc != RC_OK && prefetched != PREFETCH_NONE) {
+                //Reading ahead failed, drop the page and read it like any other miss
+                lockPartition(mgmt, part);
+                lockPolicy(mgmt);
+                if (pageTableLookup(&part->table, pageNum) == i) {
+                    pageTableRemove(&part->table, pageNum);
+                    mgmt->frames[i].pageNum = NO_PAGE;
+                    policyOnEvict(bm, i);
                 }
-            } else {
-                // If there is an empty slot, load the page
-                SM_FileHandle fh;
-                openPageFile(bm->pageFile, &fh);
-                pageFrame[i].data = (SM_PageHandle) malloc(PAGE_SIZE);
-                readBlock(pageNum, &fh, pageFrame[i].data);
-                pageFrame[i].pageNum = pageNum;
-                pageFrame[i].fixCount = 1;
-                pageFrame[i].refNum = 0;
-                last_index_bp++;
-                hit++;
-
-                // Update hit number based on replacement strategy between LRU and CLOCK
-                if (bm->strategy == RS_LRU)
-                    pageFrame[i].hitNum = hit;
-                else if (bm->strategy == RS_CLOCK)
-                    pageFrame[i].hitNum = 1;
+                unlockPolicy(mgmt);
+                unlockPartition(mgmt, part);
+                mgmt->frames[i].fixCount--;
+                continue;
+            }
+            if (rc != RC_OK) {
+                mgmt->frames[i].fixCount--;
+                return rc;
+            }
+            policyOnHit(bm, i);
+            if (prefetched != PREFETCH_NONE)
+                mgmt->prefetchHits++;
+            page->pageNum = pageNum;
+            page->data = mgmt->frames[i].data;
+            return RC_OK;
+        }
 
+        // Use an empty frame if there is one, otherwise ask the replacement strategy
+        lockPolicy(mgmt);
+        if (mgmt->admission != NULL) {
+            //A page in the bypass frame is shared like a resident one, it must not be loaded twice
+            i = mgmt->bypass;
+            if (mgmt->frames[i].pageNum == pageNum) {
+                mgmt->frames[i].fixCount++;
+                unlockPolicy(mgmt);
+                unlockPartition(mgmt, part);
+                rc = waitForFrame(mgmt, i, false);
+                if (rc != RC_OK) {
+                    unpinBypass(bm);
+                    return rc;
+                }
                 page->pageNum = pageNum;
-                page->data = pageFrame[i].data;
-                isBufferFull = false;
-                break;
+                page->data = mgmt->frames[i].data;
+                return RC_OK;
+            }
+            if (!recorded)
+                admissionRecord(mgmt->admission, pageNum);
+            recorded = true;
+        }
+        i = (hint == BM_ACCESS_SEQUENTIAL) ? ringVictim(mgmt) : -1;
+        fromRing = i >= 0;
+        evicted = fromRing || mgmt->usedFrames == bm->numPages;
+        if (!fromRing)
+            i = evicted ? pickVictim(bm, pageNum) : mgmt->usedFrames;
+        if (i < 0) {
+            unlockPolicy(mgmt);
+            unlockPartition(mgmt, part);
+            //Frames may only be waiting for prefetch reads that are still in flight
+            if (!drained && mgmt->io != NULL) {
+                drained = true;
+                waitAllIO(mgmt->io);
+                continue;
             }
+            return RC_BP_NO_FREE_FRAME;
+        }
+        frame = &mgmt->frames[i];
+
+        //A page used less than the victim lately is served from the bypass frame, if it is free.
+        //A frame of the ring only ever held scan pages, the filter leaves it to the scan.
+        if (evicted && !fromRing && frame->pageNum != NO_PAGE && mgmt->admission != NULL
+            && mgmt->frames[mgmt->bypass].fixCount == 0 && !admitPage(mgmt, pageNum, frame->pageNum)) {
+            i = mgmt->bypass;
+            frame = &mgmt->frames[i];
+            bypassed = true;
+            break;
         }
 
-        // If the buffer is full, evict a page using the appropriate strategy
-        if (isBufferFull == true) {
-            PageFrame *newPage = (PageFrame *) malloc(sizeof(PageFrame));
-            SM_FileHandle fh;
-            openPageFile(bm->pageFile, &fh);
-            newPage->data = (SM_PageHandle) malloc(PAGE_SIZE);
-            readBlock(pageNum, &fh, newPage->data);
-            newPage->pageNum = pageNum;
-            newPage->dirtyBit = 0;
-            newPage->fixCount = 1;
-            newPage->refNum = 0;
-            last_index_bp++;
-            hit++;
-
-            // Update hit number based on replacement strategy
-            if (bm->strategy == RS_LRU)
-                newPage->hitNum = hit;
-            else if (bm->strategy == RS_CLOCK)
-                newPage->hitNum = 1;
+        if (evicted && frame->pageNum != NO_PAGE) {
+            victimPart = partitionOf(mgmt, frame->pageNum);
+            //Taking a second partition lock out of order could deadlock, back off instead
+            if (victimPart != part && !tryLockPartition(mgmt, victimPart)) {
+                unlockPolicy(mgmt);
+                unlockPartition(mgmt, part);
+                sched_yield();
+                continue;
+            }
+            //A dirty victim is written back while it is still mapped, so nobody can
+            //read the stale copy from disk. The frame is then clean and can be taken.
+            if (frame->fixCount != 0 || frame->dirtyBit == 1) {
+                dirtyVictim = frame->fixCount == 0;
+                if (dirtyVictim)
+                    frame->fixCount++;
+                if (victimPart != part)
+                    unlockPartition(mgmt, victimPart);
+                unlockPolicy(mgmt);
+                unlockPartition(mgmt, part);
+                if (!dirtyVictim) {
+                    //A hit pinned the victim after the strategy picked it, let it go on first
+                    sched_yield();
+                    continue;
+                }
+                mgmt->syncWrites++;
+                rc = writeFrame(bm, i);
+                //A client that pinned the page meanwhile may have changed it again, then
+                //the next victim is picked after a back-off instead of writing this one again
+                lockFrame(mgmt, i);
+                redirtied = frame->dirtyBit == 1;
+                unlockFrame(mgmt, i);
+                frame->fixCount--;
+                if (rc != RC_OK)
+                    return rc;
+                if (redirtied)
+                    sched_yield();
+                continue;
+            }
+            pageTableRemove(&victimPart->table, frame->pageNum);
+            if (frame->prefetched)
+                mgmt->prefetchWasted++;
+            if (victimPart != part)
+                unlockPartition(mgmt, victimPart);
+            policyOnEvict(bm, i);
+        }
+        break;
+    }
 
-            page->pageNum = pageNum;
-            page->data = newPage->data;
+    //The frame is ours: map the page and mark it as being read before dropping the locks
+    if (!evicted)
+        mgmt->usedFrames++;
+    frame->pageNum = pageNum;
+    setDirty(mgmt, i, 0);
+    frame->fixCount = 1;
+    frame->ioError = 0;
+    frame->ioInProgress = 1;
+    frame->prefetched = PREFETCH_NONE;
+    frame->version++; //Odd until the read finishes, optimistic readers of the old page fail
+    if (!bypassed) {
+        pageTableInsert(&part->table, pageNum, i);
+        policyOnLoad(bm, i);
+    }
+    if (!bypassed && hint == BM_ACCESS_SEQUENTIAL)
+        ringRecord(mgmt, i, pageNum);
+    unlockPolicy(mgmt);
+    unlockPartition(mgmt, part);
+
+    //The read is started with no pool lock held, only this frame waits for it. Reads of
+    //the pages expected next are queued behind it, and one system call submits them all.
+    //An mmap pool only points the frame at the page, the kernel reads it on first access.
+    if (mgmt->map != NULL) {
+        rc = mapFrame(mgmt, i, pageNum);
+    } else {
+        rc = startFrameRead(mgmt, i, pageNum);
+        if (rc == RC_OK) {
+            readAhead(bm, pageNum, hint);
+            if (hint == BM_ACCESS_NORMAL)
+                speculate(bm, pageNum, false);
+            rc = waitIO(mgmt->io, &mgmt->ioRequests[i]);
+        }
+    }
 
-            // Use the appropriate replacement strategy to evict a page
-            switch (bm->strategy) {
-                case RS_FIFO:
-                    FIFO(bm, newPage);
-                    break;
+    if (rc != RC_OK && bypassed) {
+        unpinBypass(bm);
+        return rc;
+    }
+    if (rc != RC_OK) {
+        //Drop the mapping, the frame goes back to the replacement strategy as an empty one
+        lockPartition(mgmt, part);
+        lockPolicy(mgmt);
+        pageTableRemove(&part->table, pageNum);
+        frame->pageNum = NO_PAGE;
+        policyOnEvict(bm, i);
+        unlockPolicy(mgmt);
+        unlockPartition(mgmt, part);
+        frame->fixCount--;
+        return rc;
+    }
+
+    page->pageNum = pageNum;
+    page->data = frame->data;
+    return RC_OK;
+}
+
+//prefetchPages starts reading the n pages listed in pages into the pool and returns without
+//waiting for any of them. The pages are not pinned. A later pinPage of one of them hits, or
+//waits for its read if it is still in flight. Like read-ahead it takes only empty frames or
+//clean unpinned victims, so a page that finds no frame without waiting is skipped and read by
+//pinPage as usual, and so are pages past the end of the file. An mmap pool asks the kernel
+//to read the pages into the page cache instead.
+extern RC prefetchPages(BM_BufferPool *const bm, const PageNumber *pages, int n) {
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bm->mgmtData;
+    int j;
+
+    if (mgmt == NULL)
+        return RC_BP_NOT_INITIALIZED;
+    if (n < 0 || (n > 0 && pages == NULL))
+        return RC_ERROR;
+    for (j = 0; j < n; j++)
+        if (pages[j] < 0)
+            return RC_READ_NON_EXISTING_PAGE;
+
+    if (mgmt->map != NULL) {
+        for (j = 0; j < n; j++)
+            if (pages[j] < mgmt->mappedPages)
+                madvise(mgmt->map + (size_t)pages[j] * PAGE_SIZE, PAGE_SIZE, MADV_WILLNEED);
+        return RC_OK;
+    }
+    //Frames of earlier prefetches that have arrived can be taken again
+    pollIO(mgmt->io);
+    for (j = 0; j < n; j++)
+        if (pages[j] < mgmt->fh.totalNumPages)
+            prefetchPage(bm, pages[j], BM_ACCESS_NORMAL, PREFETCH_EXPLICIT);
+    //All reads go to the kernel at once
+    submitIO(mgmt->io);
+    return RC_OK;
+}
 
-                case RS_LRU:
-                    LRU(bm, newPage);
-                    break;
+//Frame holding a page the caller has pinned. The pin keeps the mapping stable.
+static int pinnedFrameOf(BM_PoolMgmt *mgmt, PageNumber pageNum) {
+    PagePartition *part = partitionOf(mgmt, pageNum);
+    int i;
 
-                case RS_CLOCK:
-                    CLOCK(bm, newPage);
-                    break;
+    lockPartition(mgmt, part);
+    i = pageTableLookup(&part->table, pageNum);
+    unlockPartition(mgmt, part);
+    //A page the admission filter turned away is only in the bypass frame
+    if (i < 0 && mgmt->bypass >= 0 && mgmt->frames[mgmt->bypass].pageNum == pageNum)
+        i = mgmt->bypass;
+    return i;
+}
 
-                case RS_LFU:
-                    LFU(bm, newPage);
-                    break;
+//pinPageShared pins a page for reading. Any number of clients may hold a page
+//shared at the same time, exclusive holders wait until they have all unpinned it.
+extern RC pinPageShared(BM_BufferPool *const bm, BM_PageHandle *const page, const PageNumber pageNum) {
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bm->mgmtData;
+    RC rc = pinPage(bm, page, pageNum);
 
-                case RS_LRU_K:
-                    printf("\n LRU-k algorithm not implemented");
-                    break;
+    if (rc == RC_OK && mgmt->concurrent)
+        pthread_rwlock_rdlock(&mgmt->latches[pinnedFrameOf(mgmt, pageNum)].content);
+    return rc;
+}
 
-                default:
-                    printf("\nAlgorithm Not Implemented\n");
-                    break;
-            }
-        }
-        return RC_OK;
+//pinPageExclusive pins a page for writing, no other shared or exclusive holder is let in
+//until unpinPageExclusive. Optimistic readers overlapping the pin fail their validation.
+extern RC pinPageExclusive(BM_BufferPool *const bm, BM_PageHandle *const page, const PageNumber pageNum) {
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bm->mgmtData;
+    RC rc = pinPage(bm, page, pageNum);
+    int i;
+
+    if (rc != RC_OK)
+        return rc;
+    i = pinnedFrameOf(mgmt, pageNum);
+    if (mgmt->concurrent)
+        pthread_rwlock_wrlock(&mgmt->latches[i].content);
+    mgmt->frames[i].version++;
+    return RC_OK;
+}
+
+extern RC unpinPageShared(BM_BufferPool *const bm, BM_PageHandle *const page) {
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bm->mgmtData;
+    int i;
+
+    if (mgmt == NULL)
+        return RC_BP_NOT_INITIALIZED;
+    i = pinnedFrameOf(mgmt, page->pageNum);
+    if (i < 0)
+        return RC_ERROR;
+    if (mgmt->concurrent)
+        pthread_rwlock_unlock(&mgmt->latches[i].content);
+    return unpinPage(bm, page);
+}
+
+extern RC unpinPageExclusive(BM_BufferPool *const bm, BM_PageHandle *const page) {
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bm->mgmtData;
+    int i;
+
+    if (mgmt == NULL)
+        return RC_BP_NOT_INITIALIZED;
+    i = pinnedFrameOf(mgmt, page->pageNum);
+    if (i < 0)
+        return RC_ERROR;
+    //Even again: the new content is complete before the latch is released
+    mgmt->frames[i].version++;
+    if (mgmt->concurrent)
+        pthread_rwlock_unlock(&mgmt->latches[i].content);
+    return unpinPage(bm, page);
+}
+
+//pinPageOptimistic hands out a resident page without pinning it or touching its latch,
+//which avoids all writes to the frame. Only the page table partition is locked for the
+//lookup. A page that is not in the pool is read in first and then unpinned right away,
+//unless the admission filter put it in the bypass frame: that frame gives up its page on
+//the last unpin, so its pin is kept until unpinPageOptimistic.
+extern RC pinPageOptimistic(BM_BufferPool *const bm, BM_PageHandle *const page, const PageNumber pageNum, BM_ReadToken *const token) {
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bm->mgmtData;
+    PagePartition *part;
+    RC rc;
+    int i;
+
+    if (mgmt == NULL)
+        return RC_BP_NOT_INITIALIZED;
+    if (pageNum < 0)
+        return RC_READ_NON_EXISTING_PAGE;
+
+    part = partitionOf(mgmt, pageNum);
+    lockPartition(mgmt, part);
+    i = pageTableLookup(&part->table, pageNum);
+    if (i >= 0)
+        token->version = mgmt->frames[i].version;
+    unlockPartition(mgmt, part);
+
+    if (i < 0) {
+        rc = pinPage(bm, page, pageNum);
+        if (rc != RC_OK)
+            return rc;
+        i = pinnedFrameOf(mgmt, pageNum);
+        token->version = mgmt->frames[i].version;
+        if (i != mgmt->bypass)
+            unpinPage(bm, page);
     }
+
+    token->frame = i;
+    page->pageNum = pageNum;
+    page->data = mgmt->frames[i].data;
+    return RC_OK;
+}
+
+//unpinPageOptimistic ends an optimistic read. It returns RC_OK if the frame still holds the
+//page and nobody wrote or replaced it since pinPageOptimistic, RC_BP_OPTIMISTIC_READ_FAILED otherwise.
+//The pin pinPageOptimistic kept on the bypass frame is released either way.
+extern RC unpinPageOptimistic(BM_BufferPool *const bm, BM_PageHandle *const page, const BM_ReadToken *const token) {
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bm->mgmtData;
+    PageFrame *frame;
+    RC rc = RC_OK;
+
+    if (mgmt == NULL)
+        return RC_BP_NOT_INITIALIZED;
+    frame = &mgmt->frames[token->frame];
+    //Order the caller's reads of the page before the version check
+    atomic_thread_fence(memory_order_acquire);
+    if ((token->version & 1) != 0 || frame->version != token->version || frame->pageNum != page->pageNum)
+        rc = RC_BP_OPTIMISTIC_READ_FAILED;
+    if (token->frame == mgmt->bypass)
+        unpinBypass(bm);
+    return rc;
 }
 
 
@@ -507,16 +3309,17 @@ extern RC pinPage(BM_BufferPool *const bm, BM_PageHandle *const page, const Page
 // pool's page frames.
 extern PageNumber *getFrameContents(BM_BufferPool *const bm) {
     //Allocate memory for the array of PageNumbers
-    PageNumber *frameContents = malloc(sizeof(PageNumber) * buffer_size);
-    PageFrame *pageFrame = (PageFrame *) bm->mgmtData;
+    PageNumber *frameContents = malloc(sizeof(PageNumber) * bm->numPages);
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bm->mgmtData;
+    PageFrame *pageFrame = mgmt->frames;
     int i = 0;
-   
+
    //Memory Allocation error
     if(frameContents == NULL){
         return NULL;
     }
     //to retrieve the page numbers, we can loop through each frame in pool
-    while (i < buffer_size) {
+    while (i < bm->numPages) {
         frameContents[i] = (pageFrame[i].pageNum != -1) ? pageFrame[i].pageNum : NO_PAGE;
         i++;
     }
@@ -527,10 +3330,11 @@ extern PageNumber *getFrameContents(BM_BufferPool *const bm) {
 extern bool *getDirtyFlags(BM_BufferPool *const bm) {
     //Allocate some memory for the array of dirty flags
     //Calculating the total amount of memory needed for the array
-    bool *dirtyFlags = malloc(sizeof(bool) * buffer_size);
+    bool *dirtyFlags = malloc(sizeof(bool) * bm->numPages);
 
     // Access the frames in the buffer pool's management data
-    PageFrame *pageFrame = (PageFrame *)bm->mgmtData;
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bm->mgmtData;
+    PageFrame *pageFrame = mgmt->frames;
     int i;
 
     if (dirtyFlags == NULL) {
@@ -539,7 +3343,7 @@ extern bool *getDirtyFlags(BM_BufferPool *const bm) {
     }
 
     // Iterate through the buffer pool pages to determine the dirty status
-    for (i = 0; i < buffer_size; i++) {
+    for (i = 0; i < bm->numPages; i++) {
         dirtyFlags[i] = (pageFrame[i].dirtyBit == 1) ? true : false ;
     }
 
@@ -550,18 +3354,19 @@ extern bool *getDirtyFlags(BM_BufferPool *const bm) {
 //It represents the fix count for each page
 extern int *getFixCounts(BM_BufferPool *const bm) {
     // Allocating memory for the array of fix counts
-    int *fixCounts = malloc(sizeof(int) * buffer_size);
+    int *fixCounts = malloc(sizeof(int) * bm->numPages);
 
     // Access the frames in the buffer pool's management data
-    PageFrame *pageFrame= (PageFrame *)bm->mgmtData;
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bm->mgmtData;
+    PageFrame *pageFrame = mgmt->frames;
     int i = 0;
 
     if (fixCounts == NULL) {
         return NULL; // Memory allocation error
     }
-    
+
     // Iterate through the buffer pool pages to retrieve the fix counts
-    while (i < buffer_size) {
+    while (i < bm->numPages) {
         fixCounts[i] = (pageFrame[i].fixCount != -1) ? pageFrame[i].fixCount : 0; // Get the fix count for each page
         i++;
     }
@@ -572,21 +3377,31 @@ extern int *getFixCounts(BM_BufferPool *const bm) {
 //getNUmReadIO is used to return the number of times a page was read
 //This is helpful to choose the replacement stratergy : LRU
 extern int getNumReadIO(BM_BufferPool *const bm) {
-    return (last_index_bp + 1);
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bm->mgmtData;
+    return mgmt->readCount;
 }
 
 //getNumWriteIO is a function used to count the number of times a page is written on to the disk
 extern int getNumWriteIO(BM_BufferPool *const bm) {
-    return track_write_count;
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bm->mgmtData;
+    return mgmt->writeCount;
 }
 
+//getNumPrefetchHits counts the pins that found their page read ahead
+extern int getNumPrefetchHits(BM_BufferPool *const bm) {
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bm->mgmtData;
+    return mgmt->prefetchHits;
+}
 
+//getNumPrefetchWasted counts the pages read ahead and replaced before anybody pinned them
+extern int getNumPrefetchWasted(BM_BufferPool *const bm) {
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bm->mgmtData;
+    return mgmt->prefetchWasted;
+}
 
-
-
-
-
-
-
-
-
+//getNumSyncWrites counts the misses whose victim was dirty and had to be written back
+//before the client could have the frame
+extern int getNumSyncWrites(BM_BufferPool *const bm) {
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bm->mgmtData;
+    return mgmt->syncWrites;
+}
@@ -7,19 +7,45 @@
 // Include bool DT
 #include "dt.h"
 
+// Include the asynchronous page I/O engines
+#include "io_engine.h"
+
 // Replacement Strategies
 typedef enum ReplacementStrategy {
   RS_FIFO = 0,
   RS_LRU = 1,
   RS_CLOCK = 2,
   RS_LFU = 3,
-  RS_LRU_K = 4
+  RS_LRU_K = 4,
+  RS_ARC = 5,
+  RS_2Q = 6,
+  RS_CUSTOM = 7
 } ReplacementStrategy;
 
 // Data Types and Structures
 typedef int PageNumber;
 #define NO_PAGE -1
 
+// Settings of RS_LRU_K, passed to initBufferPool as stratData. NULL uses K = 2 and
+// no correlated reference period, so every pin of a page counts as a reference.
+typedef struct BM_LRUKParams {
+  int k;                 // uncorrelated references remembered per page
+  int correlatedPeriod;  // pins of a page closer than this many pins count as one reference, 0 for none
+} BM_LRUKParams;
+
+// Settings of RS_LFU, passed to initBufferPool as stratData. NULL halves the reference
+// counts after every ten times as many references as the pool has frames.
+typedef struct BM_LFUParams {
+  int agingPeriod;       // references between two halvings of all counts, 0 for the default
+} BM_LFUParams;
+
+// Settings of RS_2Q, passed to initBufferPool as stratData. NULL lets A1in hold a quarter
+// of the frames and A1out remember as many pages as half the frames.
+typedef struct BM_2QParams {
+  int inSize;            // frames A1in holds before its oldest page is evicted, 0 for the default
+  int outSize;           // page numbers of pages evicted from A1in remembered in A1out, 0 for the default
+} BM_2QParams;
+
 typedef struct BM_BufferPool {
   char *pageFile;
   int numPages;
@@ -33,6 +59,58 @@ typedef struct BM_PageHandle {
   char *data;
 } BM_PageHandle;
 
+// A replacement strategy. Every built in strategy is one of these, and RS_CUSTOM takes
+// one as stratData. Frames are numbered 0 to numFrames - 1. The callbacks run under the
+// pool's policy lock, so the state needs no locking of its own. Only pickVictim is
+// required: it returns an unpinned frame (see isFramePinned) or -1, must not change
+// anything but hints of its own, and is asked again if the pool cannot take the frame.
+typedef struct BM_ReplacementPolicy {
+  const char *name;
+  void *(*init) (int numFrames, void *params);        // per pool state, NULL fails initBufferPool; without init the state is params
+  void (*shutdown) (void *state);
+  void (*onLoad) (void *state, int frame, PageNumber pageNum); // frame was given pageNum on a miss
+  void (*onHit) (void *state, int frame);             // the page in frame was pinned again
+  void (*onUnpin) (void *state, int frame);           // the last pin of frame was released
+  void (*onEvict) (void *state, int frame);           // frame lost its page, before the next onLoad of it
+  int (*pickVictim) (void *state, BM_BufferPool *const bm, PageNumber pageNum); // frame to give pageNum
+  // Optional, for the background writer: stores up to max unpinned frames in the order
+  // pickVictim would take them and returns how many, without changing anything
+  int (*nextVictims) (void *state, BM_BufferPool *const bm, int *frames, int max);
+  void *params;                                       // passed to init
+} BM_ReplacementPolicy;
+
+// How the caller goes through pages, see pinPageWithHint
+typedef enum BM_AccessHint {
+  BM_ACCESS_NORMAL = 0,     // misses replace the page the replacement strategy picks
+  BM_ACCESS_SEQUENTIAL = 1  // a scan, misses recycle the frames of the pool's scan ring
+} BM_AccessHint;
+
+// Remembers which frame and frame version an optimistic read saw
+typedef struct BM_ReadToken {
+  int frame;
+  unsigned int version;
+} BM_ReadToken;
+
+// Optional pool settings, fill with initPoolOptions() before changing fields
+typedef struct BM_PoolOptions {
+  bool concurrent;    // latch the pool so several threads can pin pages at once
+  int numPartitions;  // page table partitions in concurrent mode (rounded up to a power of two)
+  bool hugePages;     // back frame memory with huge pages, falls back to normal pages
+  int numaNode;       // bind frame memory to this NUMA node, -1 leaves placement to the kernel
+  bool directIO;      // open the page file with O_DIRECT, falls back to buffered I/O
+  IO_EngineKind ioEngine; // io_uring if available, or IO_ENGINE_THREADS to force worker threads
+  bool mmapPages;     // map the page file, pins point into the mapping instead of a frame copy
+  bool admissionFilter; // replace a page only for one used more often lately (TinyLFU), not for mmap pools
+  int scanRingSize;   // bytes of frames sequential pins recycle, 256 KB to 16 MB and at most an eighth of the pool
+  bool readAhead;     // read the next pages in the background while pins walk the file in order, not for mmap pools
+  bool prefetcher;    // load pages predicted by strides and by pages that followed each other before, not for mmap pools
+  int prefetchBudget; // speculative reads the prefetcher may have outstanding or wasted before it slows down
+  bool backgroundWriter; // a thread writes dirty pages back before they are replaced, latches the pool like concurrent
+  int bgWriterDelay;  // milliseconds between two rounds of the background writer
+  int bgWriterMaxPages; // most pages the background writer writes per round
+  int dirtyWatermark; // percent of the frames dirty that wakes the background writer before its delay ran out
+} BM_PoolOptions;
+
 // convenience macros
 #define MAKE_POOL()					\
   ((BM_BufferPool *) malloc (sizeof(BM_BufferPool)))
@@ -44,6 +122,10 @@ typedef struct BM_PageHandle {
 RC initBufferPool(BM_BufferPool *const bm, const char *const pageFileName, 
 		  const int numPages, ReplacementStrategy strategy, 
 		  void *stratData);
+void initPoolOptions(BM_PoolOptions *const options);
+RC initBufferPoolWithOptions(BM_BufferPool *const bm, const char *const pageFileName,
+		  const int numPages, ReplacementStrategy strategy,
+		  void *stratData, const BM_PoolOptions *const options);
 RC shutdownBufferPool(BM_BufferPool *const bm);
 RC forceFlushPool(BM_BufferPool *const bm);
 
@@ -53,6 +135,25 @@ RC unpinPage (BM_BufferPool *const bm, BM_PageHandle *const page);
 RC forcePage (BM_BufferPool *const bm, BM_PageHandle *const page);
 RC pinPage (BM_BufferPool *const bm, BM_PageHandle *const page, 
 	    const PageNumber pageNum);
+RC pinPageWithHint (BM_BufferPool *const bm, BM_PageHandle *const page,
+	    const PageNumber pageNum, BM_AccessHint hint);
+// Starts reading pages into the pool without pinning them or waiting for the reads
+RC prefetchPages (BM_BufferPool *const bm, const PageNumber *pages, int n);
+
+// Pins with read or write access, the page latch is held until the matching unpin
+RC pinPageShared (BM_BufferPool *const bm, BM_PageHandle *const page,
+	    const PageNumber pageNum);
+RC pinPageExclusive (BM_BufferPool *const bm, BM_PageHandle *const page,
+	    const PageNumber pageNum);
+RC unpinPageShared (BM_BufferPool *const bm, BM_PageHandle *const page);
+RC unpinPageExclusive (BM_BufferPool *const bm, BM_PageHandle *const page);
+
+// Optimistic reads neither pin nor latch the page. The data read in between is
+// only valid if unpinPageOptimistic returns RC_OK, otherwise the caller retries.
+RC pinPageOptimistic (BM_BufferPool *const bm, BM_PageHandle *const page,
+	    const PageNumber pageNum, BM_ReadToken *const token);
+RC unpinPageOptimistic (BM_BufferPool *const bm, BM_PageHandle *const page,
+	    const BM_ReadToken *const token);
 
 // Statistics Interface
 PageNumber *getFrameContents (BM_BufferPool *const bm);
@@ -60,5 +161,11 @@ bool *getDirtyFlags (BM_BufferPool *const bm);
 int *getFixCounts (BM_BufferPool *const bm);
 int getNumReadIO (BM_BufferPool *const bm);
 int getNumWriteIO (BM_BufferPool *const bm);
+int getNumPrefetchHits (BM_BufferPool *const bm);
+int getNumPrefetchWasted (BM_BufferPool *const bm);
+int getNumSyncWrites (BM_BufferPool *const bm);
+
+// Replacement policy support
+bool isFramePinned (BM_BufferPool *const bm, int frame);
 
 #endif
@@ -20,6 +20,9 @@ typedef int RC;
 #define RC_BP_SHUNTDOWN_ERROR 7
 #define RC_BP_FLUSHPOOL_FAILED 8
 #define RC_BP_INIT_ERROR 9
+#define RC_BP_NOT_INITIALIZED 10
+#define RC_BP_NO_FREE_FRAME 11
+#define RC_BP_OPTIMISTIC_READ_FAILED 12
 #define RC_ERROR 400
 //Adding new defintion to handle pinned pages are still in the buffer
 #define RC_PINNED_PAGES_IN_BUFFER 500
@@ -0,0 +1,490 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+#include "io_engine.h"
+
+//Worker threads of the fallback engine
+#define IO_WORKER_THREADS 4
+
+//An engine moves pages of one page file, either through an io_uring instance driven
+//with raw syscalls or, where the kernel has none, through a few threads doing pread/pwrite.
+//Requests are queued by startIO, handed to the kernel by submitIO, and completed by
+//whichever thread waits: one waiter at a time reaps the completion queue for everybody.
+struct IO_Engine {
+    IO_EngineKind kind;
+    SM_FileHandle *fh;
+    pthread_mutex_t lock;
+    pthread_cond_t progress; //Broadcast whenever requests complete
+    int inflight;            //Started and not yet completed
+
+    //io_uring
+    int ringFd;
+    unsigned int entries;
+    int reaping;              //A thread is waiting in the kernel or running callbacks
+    void *sqRing, *cqRing;
+    size_t sqRingSize, cqRingSize;
+    struct io_uring_sqe *sqes;
+    size_t sqesSize;
+    unsigned int *sqHead, *sqTail, *sqMask, *sqArray;
+    unsigned int *cqHead, *cqTail, *cqMask;
+    struct io_uring_cqe *cqes;
+
+    //Worker threads
+    pthread_t workers[IO_WORKER_THREADS];
+    int numWorkers;
+    pthread_cond_t queued;
+    IO_Request *queueHead, *queueTail;
+    int stopping;
+};
+
+//Synchronous transfer, used by the worker threads and to finish requests io_uring could not complete
+static RC transferSync(IO_Engine *engine, IO_Request *req) {
+    if (req->numPages > 1) {
+        if (req->op == IO_READ)
+            return readBlocks(req->pageNum, req->numPages, engine->fh, req->pages);
+        return writeBlocks(req->pageNum, req->numPages, engine->fh, req->pages);
+    }
+    if (req->op == IO_READ)
+        return readBlock(req->pageNum, engine->fh, req->data);
+    return writeBlock(req->pageNum, engine->fh, req->data);
+}
+
+//Bytes a request moves when it completes in full
+static inline int requestBytes(IO_Request *req) {
+    return (req->numPages > 1 ? req->numPages : 1) * PAGE_SIZE;
+}
+
+//io_uring engine
+
+static int ioUringSetup(unsigned int entries, struct io_uring_params *params) {
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int ioUringEnter(int ringFd, unsigned int toSubmit, unsigned int minComplete, unsigned int flags) {
+    return (int)syscall(__NR_io_uring_enter, ringFd, toSubmit, minComplete, flags, NULL, 0);
+}
+
+static int ioUringRegister(int ringFd, unsigned int opcode, void *arg, unsigned int numArgs) {
+    return (int)syscall(__NR_io_uring_register, ringFd, opcode, arg, numArgs);
+}
+
+//Checks that the kernel knows the read and write opcodes, plain (Linux 5.6 and later) and vectored
+static int ringSupportsReadWrite(int ringFd) {
+    size_t size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, size);
+    int supported = 0;
+
+    if (probe == NULL)
+        return 0;
+    if (ioUringRegister(ringFd, IORING_REGISTER_PROBE, probe, 256) == 0
+        && probe->last_op >= IORING_OP_WRITE
+        && (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED)
+        && (probe->ops[IORING_OP_WRITE].flags & IO_URING_OP_SUPPORTED)
+        && (probe->ops[IORING_OP_READV].flags & IO_URING_OP_SUPPORTED)
+        && (probe->ops[IORING_OP_WRITEV].flags & IO_URING_OP_SUPPORTED))
+        supported = 1;
+    free(probe);
+    return supported;
+}
+
+static void unmapRing(IO_Engine *engine) {
+    if (engine->sqes != NULL && engine->sqes != MAP_FAILED)
+        munmap(engine->sqes, engine->sqesSize);
+    if (engine->cqRing != NULL && engine->cqRing != MAP_FAILED && engine->cqRing != engine->sqRing)
+        munmap(engine->cqRing, engine->cqRingSize);
+    if (engine->sqRing != NULL && engine->sqRing != MAP_FAILED)
+        munmap(engine->sqRing, engine->sqRingSize);
+    close(engine->ringFd);
+}
+
+//Creates the ring and maps its queues. Returns RC_ERROR if io_uring is missing,
+//disabled (e.g. by seccomp or kernel.io_uring_disabled), or too old.
+static RC initRing(IO_Engine *engine, int queueDepth) {
+    struct io_uring_params params;
+    char *sq, *cq;
+
+    memset(&params, 0, sizeof(params));
+    engine->ringFd = ioUringSetup(queueDepth, &params);
+    if (engine->ringFd < 0)
+        return RC_ERROR;
+    if (!ringSupportsReadWrite(engine->ringFd)) {
+        close(engine->ringFd);
+        return RC_ERROR;
+    }
+
+    engine->entries = params.sq_entries;
+    engine->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    engine->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    //Newer kernels map both rings with one call
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (engine->cqRingSize > engine->sqRingSize)
+            engine->sqRingSize = engine->cqRingSize;
+        engine->cqRingSize = engine->sqRingSize;
+    }
+    engine->sqRing = mmap(NULL, engine->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          engine->ringFd, IORING_OFF_SQ_RING);
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+        engine->cqRing = engine->sqRing;
+    else
+        engine->cqRing = mmap(NULL, engine->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                              engine->ringFd, IORING_OFF_CQ_RING);
+    engine->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    engine->sqes = mmap(NULL, engine->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        engine->ringFd, IORING_OFF_SQES);
+    if (engine->sqRing == MAP_FAILED || engine->cqRing == MAP_FAILED || engine->sqes == MAP_FAILED) {
+        unmapRing(engine);
+        return RC_ERROR;
+    }
+
+    sq = engine->sqRing;
+    cq = engine->cqRing;
+    engine->sqHead = (unsigned int *)(sq + params.sq_off.head);
+    engine->sqTail = (unsigned int *)(sq + params.sq_off.tail);
+    engine->sqMask = (unsigned int *)(sq + params.sq_off.ring_mask);
+    engine->sqArray = (unsigned int *)(sq + params.sq_off.array);
+    engine->cqHead = (unsigned int *)(cq + params.cq_off.head);
+    engine->cqTail = (unsigned int *)(cq + params.cq_off.tail);
+    engine->cqMask = (unsigned int *)(cq + params.cq_off.ring_mask);
+    engine->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    return RC_OK;
+}
+
+//Requests queued in the submission ring that the kernel has not consumed yet
+static inline unsigned int pendingSubmissions(IO_Engine *engine) {
+    return *engine->sqTail - __atomic_load_n(engine->sqHead, __ATOMIC_ACQUIRE);
+}
+
+//Hands the queued submissions to the kernel. Called with the engine lock held.
+static void submitRing(IO_Engine *engine) {
+    while (pendingSubmissions(engine) > 0) {
+        int submitted = ioUringEnter(engine->ringFd, pendingSubmissions(engine), 0, 0);
+
+        if (submitted < 0 && errno == EINTR)
+            continue;
+        //EAGAIN or EBUSY: the kernel is short on resources, the next wait retries
+        if (submitted <= 0)
+            break;
+    }
+}
+
+//Moves finished requests off the completion ring into a list. Called with the engine lock held.
+static IO_Request *reapRing(IO_Engine *engine) {
+    IO_Request *completed = NULL;
+    unsigned int head = *engine->cqHead;
+    unsigned int tail = __atomic_load_n(engine->cqTail, __ATOMIC_ACQUIRE);
+
+    while (head != tail) {
+        struct io_uring_cqe *cqe = &engine->cqes[head & *engine->cqMask];
+        IO_Request *req = (IO_Request *)(uintptr_t)cqe->user_data;
+
+        req->result = cqe->res;
+        req->next = completed;
+        completed = req;
+        engine->inflight--;
+        head++;
+    }
+    __atomic_store_n(engine->cqHead, head, __ATOMIC_RELEASE);
+    return completed;
+}
+
+//Finishes the requests reapRing took off the ring and wakes their waiters. Called with
+//the engine lock held by the thread that set reaping, returns with it held.
+static void completeRing(IO_Engine *engine, IO_Request *completed) {
+    IO_Request *req, *next;
+
+    pthread_mutex_unlock(&engine->lock);
+    //Short transfers and direct I/O the filesystem refused are finished synchronously,
+    //the storage manager retries them and drops O_DIRECT if needed
+    for (req = completed; req != NULL; req = next) {
+        next = req->next;
+        free(req->iov);
+        req->iov = NULL;
+        if (req->result == requestBytes(req))
+            req->rc = RC_OK;
+        else
+            req->rc = transferSync(engine, req);
+        if (req->onComplete != NULL)
+            req->onComplete(req);
+    }
+
+    pthread_mutex_lock(&engine->lock);
+    for (req = completed; req != NULL; req = req->next)
+        req->done = 1;
+    engine->reaping = 0;
+    pthread_cond_broadcast(&engine->progress);
+}
+
+//Waits until some requests completed. Called with the engine lock held and
+//returns with it held. The first waiter enters the kernel and completes requests
+//for everybody, the others sleep until it is done.
+static void waitProgress(IO_Engine *engine) {
+    IO_Request *completed;
+    unsigned int toSubmit;
+
+    if (engine->kind == IO_ENGINE_THREADS) {
+        pthread_cond_wait(&engine->progress, &engine->lock);
+        return;
+    }
+    //Another waiter is in the kernel already, hand over what it did not submit and sleep
+    if (engine->reaping) {
+        submitRing(engine);
+        pthread_cond_wait(&engine->progress, &engine->lock);
+        return;
+    }
+
+    //Submitting and waiting take one system call, so a lone miss costs no more than a pread.
+    //Completions already on the ring are taken without entering the kernel.
+    engine->reaping = 1;
+    toSubmit = pendingSubmissions(engine);
+    if (toSubmit > 0 || *engine->cqHead == __atomic_load_n(engine->cqTail, __ATOMIC_ACQUIRE)) {
+        pthread_mutex_unlock(&engine->lock);
+        while (ioUringEnter(engine->ringFd, toSubmit, 1, IORING_ENTER_GETEVENTS) < 0 && errno == EINTR)
+            ;
+        pthread_mutex_lock(&engine->lock);
+    }
+    completed = reapRing(engine);
+    completeRing(engine, completed);
+}
+
+//Completes the requests the kernel has finished, without entering the kernel or waiting.
+//Called with the engine lock held and returns with it held. If a waiter is reaping
+//already it completes them itself.
+static void pollRing(IO_Engine *engine) {
+    if (engine->reaping || __atomic_load_n(engine->cqHead, __ATOMIC_ACQUIRE) == __atomic_load_n(engine->cqTail, __ATOMIC_ACQUIRE))
+        return;
+    engine->reaping = 1;
+    completeRing(engine, reapRing(engine));
+}
+
+static RC startRing(IO_Engine *engine, IO_Request *req) {
+    struct io_uring_sqe *sqe;
+    struct iovec *iov = NULL;
+    unsigned int tail, index;
+    int i;
+
+    //A run is read or written with one vectored request, its iovecs live until the completion
+    if (req->numPages > 1) {
+        iov = malloc(sizeof(struct iovec) * req->numPages);
+        if (iov == NULL)
+            return RC_ERROR;
+        for (i = 0; i < req->numPages; i++) {
+            iov[i].iov_base = req->pages[i];
+            iov[i].iov_len = PAGE_SIZE;
+        }
+    }
+
+    pthread_mutex_lock(&engine->lock);
+    //At most one ring's worth in flight, so neither queue can overflow
+    while (engine->inflight >= (int)engine->entries)
+        waitProgress(engine);
+
+    req->done = 0;
+    tail = *engine->sqTail;
+    index = tail & *engine->sqMask;
+    sqe = &engine->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->fd = getFileDescriptor(engine->fh);
+    sqe->off = (unsigned long long)req->pageNum * PAGE_SIZE;
+    if (iov != NULL) {
+        sqe->opcode = req->op == IO_READ ? IORING_OP_READV : IORING_OP_WRITEV;
+        sqe->addr = (unsigned long long)(uintptr_t)iov;
+        sqe->len = req->numPages;
+    }
+    else {
+        sqe->opcode = req->op == IO_READ ? IORING_OP_READ : IORING_OP_WRITE;
+        sqe->addr = (unsigned long long)(uintptr_t)req->data;
+        sqe->len = PAGE_SIZE;
+    }
+    req->iov = iov;
+    sqe->user_data = (unsigned long long)(uintptr_t)req;
+    engine->sqArray[index] = index;
+    __atomic_store_n(engine->sqTail, tail + 1, __ATOMIC_RELEASE);
+    engine->inflight++;
+    pthread_mutex_unlock(&engine->lock);
+    return RC_OK;
+}
+
+//Worker thread engine
+
+static void *ioWorker(void *arg) {
+    IO_Engine *engine = arg;
+    IO_Request *req;
+
+    pthread_mutex_lock(&engine->lock);
+    while (1) {
+        while (engine->queueHead == NULL && !engine->stopping)
+            pthread_cond_wait(&engine->queued, &engine->lock);
+        if (engine->queueHead == NULL)
+            break;
+        req = engine->queueHead;
+        engine->queueHead = req->next;
+        if (engine->queueHead == NULL)
+            engine->queueTail = NULL;
+        pthread_mutex_unlock(&engine->lock);
+
+        req->rc = transferSync(engine, req);
+        if (req->onComplete != NULL)
+            req->onComplete(req);
+
+        pthread_mutex_lock(&engine->lock);
+        req->done = 1;
+        engine->inflight--;
+        pthread_cond_broadcast(&engine->progress);
+    }
+    pthread_mutex_unlock(&engine->lock);
+    return NULL;
+}
+
+static RC startThreads(IO_Engine *engine, IO_Request *req) {
+    pthread_mutex_lock(&engine->lock);
+    req->done = 0;
+    req->next = NULL;
+    if (engine->queueTail != NULL)
+        engine->queueTail->next = req;
+    else
+        engine->queueHead = req;
+    engine->queueTail = req;
+    engine->inflight++;
+    pthread_cond_signal(&engine->queued);
+    pthread_mutex_unlock(&engine->lock);
+    return RC_OK;
+}
+
+static RC initThreads(IO_Engine *engine) {
+    int i;
+
+    pthread_cond_init(&engine->queued, NULL);
+    for (i = 0; i < IO_WORKER_THREADS; i++) {
+        if (pthread_create(&engine->workers[i], NULL, ioWorker, engine) != 0)
+            break;
+        engine->numWorkers++;
+    }
+    if (engine->numWorkers == 0) {
+        pthread_cond_destroy(&engine->queued);
+        return RC_ERROR;
+    }
+    return RC_OK;
+}
+
+/*
+ * Creates an I/O engine for an open page file.
+ *
+ * Parameters:
+ * - engine: Receives the new engine.
+ * - fHandle: Open page file, it must stay open until the engine is shut down.
+ * - kind: IO_ENGINE_AUTO uses io_uring when the kernel supports it and worker
+ *   threads otherwise, IO_ENGINE_THREADS always uses worker threads.
+ * - queueDepth: Most requests in flight at once on io_uring.
+ *
+ * Returns:
+ * - RC_OK if the engine is ready, otherwise an error code.
+ */
+extern RC initIOEngine(IO_Engine **engine, SM_FileHandle *fHandle, IO_EngineKind kind, int queueDepth) {
+    IO_Engine *e = calloc(1, sizeof(IO_Engine));
+
+    *engine = NULL;
+    if (e == NULL)
+        return RC_ERROR;
+    e->fh = fHandle;
+    pthread_mutex_init(&e->lock, NULL);
+    pthread_cond_init(&e->progress, NULL);
+
+    e->kind = IO_ENGINE_THREADS;
+    if (kind != IO_ENGINE_THREADS && initRing(e, queueDepth) == RC_OK)
+        e->kind = IO_ENGINE_URING;
+    else if (initThreads(e) != RC_OK) {
+        pthread_cond_destroy(&e->progress);
+        pthread_mutex_destroy(&e->lock);
+        free(e);
+        return RC_ERROR;
+    }
+    *engine = e;
+    return RC_OK;
+}
+
+//Waits for all requests, then releases the ring or stops the worker threads
+extern RC shutdownIOEngine(IO_Engine *engine) {
+    int i;
+
+    waitAllIO(engine);
+    if (engine->kind == IO_ENGINE_URING)
+        unmapRing(engine);
+    else {
+        pthread_mutex_lock(&engine->lock);
+        engine->stopping = 1;
+        pthread_cond_broadcast(&engine->queued);
+        pthread_mutex_unlock(&engine->lock);
+        for (i = 0; i < engine->numWorkers; i++)
+            pthread_join(engine->workers[i], NULL);
+        pthread_cond_destroy(&engine->queued);
+    }
+    pthread_cond_destroy(&engine->progress);
+    pthread_mutex_destroy(&engine->lock);
+    free(engine);
+    return RC_OK;
+}
+
+extern IO_EngineKind getIOEngineKind(IO_Engine *engine) {
+    return engine->kind;
+}
+
+//Queues a request. On io_uring it reaches the kernel with the next submitIO or wait,
+//so a caller can start a batch and pay for one system call.
+extern RC startIO(IO_Engine *engine, IO_Request *req) {
+    if (engine->kind == IO_ENGINE_URING)
+        return startRing(engine, req);
+    return startThreads(engine, req);
+}
+
+//Passes every queued request to the kernel without waiting for any of them, and
+//completes the ones that have finished meanwhile
+extern RC submitIO(IO_Engine *engine) {
+    if (engine->kind == IO_ENGINE_URING) {
+        pthread_mutex_lock(&engine->lock);
+        submitRing(engine);
+        pollRing(engine);
+        pthread_mutex_unlock(&engine->lock);
+    }
+    return RC_OK;
+}
+
+//Completes the requests that have finished without blocking. On io_uring a request is
+//otherwise only completed when some thread waits, so a request nobody waits for needs
+//this to run its callback. Worker threads complete their requests themselves.
+//An empty completion ring is seen without taking the lock, so polling often is cheap.
+extern RC pollIO(IO_Engine *engine) {
+    if (engine->kind == IO_ENGINE_URING
+        && __atomic_load_n(engine->cqHead, __ATOMIC_ACQUIRE) != __atomic_load_n(engine->cqTail, __ATOMIC_ACQUIRE)) {
+        pthread_mutex_lock(&engine->lock);
+        pollRing(engine);
+        pthread_mutex_unlock(&engine->lock);
+    }
+    return RC_OK;
+}
+
+//Blocks until req has completed and returns its result
+extern RC waitIO(IO_Engine *engine, IO_Request *req) {
+    pthread_mutex_lock(&engine->lock);
+    while (!req->done)
+        waitProgress(engine);
+    pthread_mutex_unlock(&engine->lock);
+    return req->rc;
+}
+
+//Blocks until every started request has completed
+extern RC waitAllIO(IO_Engine *engine) {
+    pthread_mutex_lock(&engine->lock);
+    while (engine->inflight > 0 || engine->reaping)
+        waitProgress(engine);
+    pthread_mutex_unlock(&engine->lock);
+    return RC_OK;
+}
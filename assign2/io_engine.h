@@ -0,0 +1,66 @@
+#ifndef IO_ENGINE_H
+#define IO_ENGINE_H
+
+#include "dberror.h"
+#include "storage_mgr.h"
+
+/************************************************************
+ *                    handle data structures                *
+ ************************************************************/
+typedef enum IO_EngineKind {
+  IO_ENGINE_AUTO = 0,    // io_uring if the kernel offers it, worker threads otherwise
+  IO_ENGINE_URING = 1,   // reported by getIOEngineKind, initIOEngine treats it like AUTO
+  IO_ENGINE_THREADS = 2  // worker threads doing pread/pwrite
+} IO_EngineKind;
+
+// Longest run of pages one request may carry
+#define IO_MAX_RUN 1024
+
+typedef enum IO_Op {
+  IO_READ = 0,
+  IO_WRITE = 1
+} IO_Op;
+
+typedef struct IO_Request IO_Request;
+
+// Runs once the transfer of req finished, before waitIO returns for it. It must
+// neither start nor wait for requests.
+typedef void (*IO_Callback) (IO_Request *req);
+
+// One page transfer, or a run of consecutive pages when numPages > 1. The caller
+// owns the request and must keep it alive until waitIO or waitAllIO has returned for it.
+struct IO_Request {
+  IO_Op op;
+  int pageNum;             // first page
+  char *data;              // PAGE_SIZE bytes, used when numPages <= 1
+  int numPages;            // length of the run, at most IO_MAX_RUN
+  char **pages;            // one PAGE_SIZE buffer per page of the run, used when numPages > 1
+  IO_Callback onComplete;  // may be NULL
+  void *userData;
+  RC rc;                   // result, valid once the request completed
+
+  // private to the engine
+  int done;
+  int result;
+  void *iov;
+  IO_Request *next;
+};
+
+typedef struct IO_Engine IO_Engine;
+
+/************************************************************
+ *                    interface                             *
+ ************************************************************/
+/* engines move pages of one open page file */
+extern RC initIOEngine (IO_Engine **engine, SM_FileHandle *fHandle, IO_EngineKind kind, int queueDepth);
+extern RC shutdownIOEngine (IO_Engine *engine);
+extern IO_EngineKind getIOEngineKind (IO_Engine *engine);
+
+/* queueing and completing requests */
+extern RC startIO (IO_Engine *engine, IO_Request *req);
+extern RC submitIO (IO_Engine *engine);
+extern RC pollIO (IO_Engine *engine);
+extern RC waitIO (IO_Engine *engine, IO_Request *req);
+extern RC waitAllIO (IO_Engine *engine);
+
+#endif
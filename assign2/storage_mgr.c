@@ -1,3 +1,4 @@
+#define _GNU_SOURCE // O_DIRECT
 #include<stdio.h>
 #include<stdlib.h>
 #include<sys/stat.h>
@@ -5,19 +6,163 @@
 #include<unistd.h>
 #include<string.h>
 #include<math.h>
+#include<fcntl.h>
+#include<errno.h>
+#include<pthread.h>
+#include<stdint.h>
+#include<limits.h>
+#include<sys/uio.h>
 
 #include "storage_mgr.h"
 
-FILE *pageFile;
+// State of an open page file, kept in the handle's mgmtInfo until closePageFile.
+// Blocks are read and written with pread/pwrite at their own offset, so there is no
+// shared file position and several threads can use one handle at the same time.
+typedef struct SM_FileMgmt {
+    int fd;
+    int direct;               // The descriptor bypasses the page cache with O_DIRECT
+    pthread_mutex_t growLock; // Serializes appending pages and updates of totalNumPages
+} SM_FileMgmt;
 
+// Nothing is shared between file handles, so there is no global state to set up.
 extern void initStorageManager(void) {
-    // Initialising file pointer, i.e., storage manager.
-    pageFile = NULL; // Initial pageFile to NULL
+}
+
+static inline SM_FileMgmt *fileMgmt(SM_FileHandle *fHandle) {
+    return (SM_FileMgmt *)fHandle->mgmtInfo;
+}
+
+// Byte offset of a page in the file, computed in off_t so files above 2 GB work.
+static inline off_t pageOffset(int pageNum) {
+    return (off_t)pageNum * PAGE_SIZE;
+}
+
+// Records the page last read or written. Threads sharing a handle may race on it,
+// so it is stored atomically and only means something to a single-threaded caller.
+static inline void setBlockPos(SM_FileHandle *fHandle, int pageNum) {
+    __atomic_store_n(&fHandle->curPagePos, pageNum, __ATOMIC_RELAXED);
+}
+
+static inline int isDirect(SM_FileMgmt *mgmt) {
+    return __atomic_load_n(&mgmt->direct, __ATOMIC_RELAXED);
+}
+
+// Some filesystems accept O_DIRECT on open but reject the transfers, the handle then
+// drops the flag and keeps working through the page cache.
+static void disableDirectIO(SM_FileMgmt *mgmt) {
+    int flags = fcntl(mgmt->fd, F_GETFL);
+
+    if (flags >= 0)
+        fcntl(mgmt->fd, F_SETFL, flags & ~O_DIRECT);
+    __atomic_store_n(&mgmt->direct, 0, __ATOMIC_RELAXED);
+}
+
+// Reads or writes exactly one page at pageNum, retrying short transfers and interrupts.
+// Returns the number of bytes transferred, which is less than PAGE_SIZE at end of file or on error.
+static ssize_t transferAligned(SM_FileMgmt *mgmt, int pageNum, char *memPage, int write) {
+    ssize_t done = 0;
+
+    while (done < PAGE_SIZE) {
+        ssize_t n = write ? pwrite(mgmt->fd, memPage + done, PAGE_SIZE - done, pageOffset(pageNum) + done)
+                          : pread(mgmt->fd, memPage + done, PAGE_SIZE - done, pageOffset(pageNum) + done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && errno == EINVAL && isDirect(mgmt)) {
+            disableDirectIO(mgmt);
+            continue;
+        }
+        if (n <= 0)
+            break;
+        done += n;
+    }
+    return done;
+}
+
+// Like transferAligned, but accepts any buffer. O_DIRECT needs the buffer aligned like
+// the file offsets, so an unaligned page is moved through an aligned copy.
+static ssize_t transferPage(SM_FileMgmt *mgmt, int pageNum, char *memPage, int write) {
+    char *bounce;
+    ssize_t done;
+
+    if (!isDirect(mgmt) || (uintptr_t)memPage % PAGE_SIZE == 0)
+        return transferAligned(mgmt, pageNum, memPage, write);
+
+    if (posix_memalign((void **)&bounce, PAGE_SIZE, PAGE_SIZE) != 0)
+        return -1;
+    if (write)
+        memcpy(bounce, memPage, PAGE_SIZE);
+    done = transferAligned(mgmt, pageNum, bounce, write);
+    if (!write && done == PAGE_SIZE)
+        memcpy(memPage, bounce, PAGE_SIZE);
+    free(bounce);
+    return done;
+}
+
+// Moves count consecutive pages starting at startPage, page i to or from memPages[i],
+// with preadv/pwritev so one system call covers up to IOV_MAX pages.
+// Returns the number of whole pages transferred, less than count at end of file or on error.
+static int transferPages(SM_FileMgmt *mgmt, int startPage, int count, SM_PageHandle *memPages, int write) {
+    struct iovec iov[IOV_MAX];
+    int done = 0, i;
+
+    // Under O_DIRECT every buffer must be aligned, otherwise go page by page through a bounce buffer
+    if (isDirect(mgmt)) {
+        for (i = 0; i < count; i++)
+            if ((uintptr_t)memPages[i] % PAGE_SIZE != 0)
+                break;
+        if (i < count) {
+            while (done < count && transferPage(mgmt, startPage + done, memPages[done], write) == PAGE_SIZE)
+                done++;
+            return done;
+        }
+    }
+
+    while (done < count) {
+        int run = count - done < IOV_MAX ? count - done : IOV_MAX;
+        ssize_t n;
+
+        for (i = 0; i < run; i++) {
+            iov[i].iov_base = memPages[done + i];
+            iov[i].iov_len = PAGE_SIZE;
+        }
+        n = write ? pwritev(mgmt->fd, iov, run, pageOffset(startPage + done))
+                  : preadv(mgmt->fd, iov, run, pageOffset(startPage + done));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && errno == EINVAL && isDirect(mgmt)) {
+            disableDirectIO(mgmt);
+            continue;
+        }
+        if (n <= 0)
+            break;
+        done += n / PAGE_SIZE;
+        // A page cut in half by a short transfer is finished on its own
+        if (n % PAGE_SIZE != 0) {
+            if (transferPage(mgmt, startPage + done, memPages[done], write) < PAGE_SIZE)
+                break;
+            done++;
+        }
+    }
+    return done;
+}
+
+// Grows the file to numberOfPages pages with one ftruncate, whatever the number of pages.
+// The new pages are a hole that reads back as zeros; disk space is only allocated when
+// they are written, or up front by reservePages. The caller holds growLock.
+static RC growFile(SM_FileHandle *fHandle, int numberOfPages) {
+    SM_FileMgmt *mgmt = fileMgmt(fHandle);
+
+    if (numberOfPages <= fHandle->totalNumPages)
+        return RC_OK;
+    if (ftruncate(mgmt->fd, pageOffset(numberOfPages)) != 0)
+        return RC_WRITE_FAILED;
+    __atomic_store_n(&fHandle->totalNumPages, numberOfPages, __ATOMIC_RELAXED);
+    return RC_OK;
 }
 
 extern RC createPageFile(char *fileName) {
     // Opening file stream in read & write mode. 'w+' mode creates an empty file for both reading and writing.
-    pageFile = fopen(fileName, "w+");
+    FILE *pageFile = fopen(fileName, "w+");
 
     // Checking if file was successfully opened.
     if (pageFile == NULL) {
@@ -47,46 +192,85 @@ extern RC createPageFile(char *fileName) {
     }
 }
 
-extern RC openPageFile(char *fileName, SM_FileHandle *fHandle) {
-    // Opening file stream in read mode. 'r' mode opens for reading only.
-    pageFile = fopen(fileName, "r");
+// Opens fileName and attaches it to fHandle. With direct set the file is opened with
+// O_DIRECT, or without it if the filesystem does not support direct I/O.
+static RC openFile(char *fileName, SM_FileHandle *fHandle, int direct) {
+    int fd = -1;
+    struct stat fileInfo;
+    SM_FileMgmt *mgmt;
+
+    // Opening the file for reading and writing, the descriptor stays open in the handle until closePageFile.
+    if (direct) {
+        fd = open(fileName, O_RDWR | O_DIRECT);
+        if (fd < 0 && errno == EINVAL)
+            direct = 0; // e.g. tmpfs on older kernels
+    }
+    if (!direct)
+        fd = open(fileName, O_RDWR);
 
     // Checking if file was successfully opened.
-    if (pageFile == NULL) {
+    if (fd < 0)
         return RC_FILE_NOT_FOUND; // File not found
+
+    // Using fstat() to get the file total size.
+    if (fstat(fd, &fileInfo) < 0) {
+        close(fd);
+        return RC_ERROR; // Error occurred
     }
-    else {
-        // Updating file handle's filename and setting the current position to the start of the page.
-        fHandle->fileName = fileName;
-        
-		fHandle->curPagePos = 0;
 
-        // Using fstat() to get the file total size.
-        struct stat fileInfo;
-        if (fstat(fileno(pageFile), &fileInfo) < 0)
-            return RC_ERROR; // Error occurred
+    mgmt = malloc(sizeof(SM_FileMgmt));
+    if (mgmt == NULL) {
+        close(fd);
+        return RC_ERROR;
+    }
+    mgmt->fd = fd;
+    mgmt->direct = direct;
+    pthread_mutex_init(&mgmt->growLock, NULL);
+
+    // Updating file handle's filename and setting the current position to the first page.
+    fHandle->fileName = fileName;
+    fHandle->curPagePos = 0;
+    fHandle->totalNumPages = fileInfo.st_size / PAGE_SIZE; // Total number of pages
+    fHandle->mgmtInfo = mgmt;
+    return RC_OK; // Success
+}
 
-        fHandle->totalNumPages = fileInfo.st_size / PAGE_SIZE; // Total number of pages
+extern RC openPageFile(char *fileName, SM_FileHandle *fHandle) {
+    return openFile(fileName, fHandle, 0);
+}
 
-        // Closing file stream.
-        fclose(pageFile);
-        return RC_OK; // Success
-    }
+extern RC openPageFileDirect(char *fileName, SM_FileHandle *fHandle) {
+    return openFile(fileName, fHandle, 1);
+}
+
+extern int isDirectIO(SM_FileHandle *fHandle) {
+    return fileMgmt(fHandle) != NULL && isDirect(fileMgmt(fHandle));
+}
+
+extern int getFileDescriptor(SM_FileHandle *fHandle) {
+    return fileMgmt(fHandle) != NULL ? fileMgmt(fHandle)->fd : -1;
 }
 
 extern RC closePageFile(SM_FileHandle *fHandle) {
-    // Checking if file pointer or the storage manager is initialised. If initialised, then close.
-    if (pageFile != NULL)
-        pageFile = NULL; // Nullifying pageFile
+    SM_FileMgmt *mgmt = fileMgmt(fHandle);
+
+    // Closing the descriptor opened by openPageFile.
+    if (mgmt == NULL)
+        return RC_FILE_HANDLE_NOT_INIT;
+    close(mgmt->fd);
+    pthread_mutex_destroy(&mgmt->growLock);
+    free(mgmt);
+    fHandle->mgmtInfo = NULL;
     return RC_OK; 
 }
 
 extern RC destroyPageFile(char *fileName) {
     // Opening file stream in read mode. 
-    pageFile = fopen(fileName, "r");
+    FILE *pageFile = fopen(fileName, "r");
 
     if (pageFile == NULL)
         return RC_FILE_NOT_FOUND; // File not found
+    fclose(pageFile);
 
     // Deleting the given filename so it is no longer accessible.
     remove(fileName); 
@@ -94,34 +278,43 @@ extern RC destroyPageFile(char *fileName) {
 }
 
 extern RC readBlock(int pageNum, SM_FileHandle *fHandle, SM_PageHandle memPage) {
-    // Checking if the pageNumber parameter is less than Total number of pages and less than 0.
-    
-	
-	
-	if (pageNum >= fHandle->totalNumPages || pageNum < 0)
-        return RC_READ_NON_EXISTING_PAGE; // Non-existing page error
+    SM_FileMgmt *mgmt = fileMgmt(fHandle);
 
-    // Opening file stream in read mode.
-    pageFile = fopen(fHandle->fileName, "r");
+    // Checking if the file handle is open.
+    if (mgmt == NULL)
+        return RC_FILE_HANDLE_NOT_INIT;
 
-    // Checking if file was successfully opened.
-    if (pageFile == NULL)
-        return RC_FILE_NOT_FOUND; // File not found error
+    // Checking that the page number is not negative, pages past the end of the file
+    // are caught by the short read below.
+    if (pageNum < 0)
+        return RC_READ_NON_EXISTING_PAGE; // Non-existing page error
 
-    // Setting cursor position of the file stream.
-    int isSeekSuccess = fseek(pageFile, (pageNum * PAGE_SIZE), SEEK_SET);
-    if (isSeekSuccess == 0) {
-        // Reading content into memPage.
-        if (fread(memPage, sizeof(char), PAGE_SIZE, pageFile) < PAGE_SIZE)
-            return RC_ERROR; // Read error
-    }
-    else {
+    // Reading the page straight into memPage.
+    if (transferPage(mgmt, pageNum, memPage, 0) < PAGE_SIZE)
         return RC_READ_NON_EXISTING_PAGE; // Non-existing page error
-    }
 
     // Updating current page position.
-    fHandle->curPagePos = ftell(pageFile); 
-    fclose(pageFile); // Closing the file stream
+    setBlockPos(fHandle, pageNum);
+    return RC_OK; // Success
+}
+
+extern RC readBlocks(int startPage, int count, SM_FileHandle *fHandle, SM_PageHandle *memPages) {
+    SM_FileMgmt *mgmt = fileMgmt(fHandle);
+
+    // Checking if the file handle is open.
+    if (mgmt == NULL)
+        return RC_FILE_HANDLE_NOT_INIT;
+    if (startPage < 0 || count < 0)
+        return RC_READ_NON_EXISTING_PAGE; // Non-existing page error
+    if (count == 0)
+        return RC_OK;
+
+    // Reading the whole run, a run reaching past the end of the file fails
+    if (transferPages(mgmt, startPage, count, memPages, 0) < count)
+        return RC_READ_NON_EXISTING_PAGE; // Non-existing page error
+
+    // The last page read becomes the current page.
+    setBlockPos(fHandle, startPage + count - 1);
     return RC_OK; // Success
 }
 
@@ -131,276 +324,158 @@ extern int getBlockPos(SM_FileHandle *fHandle) {
 }
 
 extern RC readFirstBlock(SM_FileHandle *fHandle, SM_PageHandle memPage) {
-    // Opening file stream in read mode.
-    pageFile = fopen(fHandle->fileName, "r");
-
-    // Checking if file was successfully opened.
-    if (pageFile == NULL)
-        return RC_FILE_NOT_FOUND; // File not found error
-
-    // Reading the first block into memPage.
-    for (int i = 0; i < PAGE_SIZE; i++) {
-        char c = fgetc(pageFile); // Reading a single character
-
-        if (feof(pageFile))
-            break; // End of file reached
-        else
-            memPage[i] = c; // Storing character
-    }
-
-    // Setting the current page position to the cursor.
-    fHandle->curPagePos = ftell(pageFile); 
-    fclose(pageFile); // Closing the file stream
-    return RC_OK; // Success
+    // Reading the first page of the file.
+    return readBlock(0, fHandle, memPage);
 }
 
 extern RC readPreviousBlock(SM_FileHandle *fHandle, SM_PageHandle memPage) {
-    // Checking if we are on the first block.
-    if (fHandle->curPagePos <= PAGE_SIZE) {
-        printf("\n First block: Previous block not present.");
-        return RC_READ_NON_EXISTING_PAGE; // No previous block error
-    }
-    else {
-        int currentPageNumber = fHandle->curPagePos / PAGE_SIZE; // Current page number
-        int startPosition = (PAGE_SIZE * (currentPageNumber - 2)); // Start position
-
-        // Opening file stream in read mode.
-        pageFile = fopen(fHandle->fileName, "r");
-
-        // Checking if file was successfully opened.
-        if (pageFile == NULL)
-            return RC_FILE_NOT_FOUND; // File not found error
-
-        // Setting file pointer position.
-        fseek(pageFile, startPosition, SEEK_SET);
-
-        // Reading block character by character.
-        for (int i = 0; i < PAGE_SIZE; i++) {
-            memPage[i] = fgetc(pageFile); // Storing character
-        }
-
-        // Setting the current page position.
-        fHandle->curPagePos = ftell(pageFile); 
-        fclose(pageFile); // Closing the file stream
-        return RC_OK; // Success
-    }
+    // Reading the page before the current one, this fails on the first page.
+    return readBlock(fHandle->curPagePos - 1, fHandle, memPage);
 }
 
-
 extern RC readCurrentBlock (SM_FileHandle *fHandle, SM_PageHandle memPage) {
-	// Calculating current page number by dividing page size by current page position	
-	int currentPageNumber = fHandle->curPagePos / PAGE_SIZE;
-	
-    int startPosition = (PAGE_SIZE * (currentPageNumber - 2));
-	
-	// Opening file stream in read mode. 'r' mode opens the file for reading only.	
-	pageFile = fopen(fHandle->fileName, "r");
-
-	// Checking if file was successfully opened.
-	if(pageFile == NULL)
-
-		return RC_FILE_NOT_FOUND;
-
-	// Initializing file pointer position.
-	fseek(pageFile, startPosition, SEEK_SET);
-	
-	int i;
-	// Reading block character by character and storing it in memPage.
-	// Also checking if we have reahed end of file.
-	for(i = 0; i < PAGE_SIZE; i++) {
-		char c = fgetc(pageFile);		
-		if(feof(pageFile))
-			break;
-		memPage[i] = c;
-	}
-	
-	// Setting the current page position to the cursor(pointer) position of the file stream
-	fHandle->curPagePos = ftell(pageFile); 
-
-	// Closing file stream so that all the buffers are flushed.
-	fclose(pageFile);
-	return RC_OK;		
+	// Reading the page last read or written.
+	return readBlock(fHandle->curPagePos, fHandle, memPage);
 }
 
 extern RC readNextBlock(SM_FileHandle *fHandle, SM_PageHandle memPage) {
-    // Check if the current position is at the last block, which means no next block exists
-    if (fHandle->curPagePos == PAGE_SIZE) {
-        printf("\n Last block: Next block not present.");
-        return RC_READ_NON_EXISTING_PAGE;
-    } else {
-        // Calculate the current page number based on the current position
-        
-		
-		int pageNumber = fHandle->curPagePos / PAGE_SIZE;
-        int readPosition = (PAGE_SIZE * (pageNumber - 2));
-
-        // Open the file in read mode
-        FILE *file = fopen(fHandle->fileName, "r");
-
-        // Check if the file opened successfully
-        if (file == NULL)
-            return RC_FILE_NOT_FOUND;
-
-        // Move the file pointer to the start position of the next block
-        fseek(file, readPosition, SEEK_SET);
-
-        // Read the block into the memory page buffer
-        for (int i = 0; i < PAGE_SIZE; i++) {
-            char ch = fgetc(file);
-            if (feof(file))
-                break;
-            memPage[i] = ch;
-        }
-
-        // Update the file handle's current page position
-        fHandle->curPagePos = ftell(file);
-
-        // Close the file after reading
-        fclose(file);
-        return RC_OK;
-    }
+    // Reading the page after the current one, this fails on the last page.
+    return readBlock(fHandle->curPagePos + 1, fHandle, memPage);
 }
 
 extern RC readLastBlock(SM_FileHandle *fHandle, SM_PageHandle memPage) {
-    // Open the file in read mode to read the last block
-    FILE *file = fopen(fHandle->fileName, "r");
-
-    // Check if the file opened successfully
-    if (file == NULL)
-        return RC_FILE_NOT_FOUND;
-
-    // Calculate the start position of the last page
-    int readPosition = (fHandle->totalNumPages - 1) * PAGE_SIZE;
-
-    
-	
-	// Set the file pointer to the start of the last block
-    
-	fseek(file, readPosition, SEEK_SET);
-
-    // Read characters from the file into the memory page buffer
-    for (int i = 0; i < PAGE_SIZE; i++) {
-        char ch = fgetc(file);
-        if (feof(file))
-            break;
-        memPage[i] = ch;
-    }
-
-    // Update the current position of the file handle
-    fHandle->curPagePos = ftell(file);
-
-    // Close the file after reading
-    fclose(file);
-    return RC_OK;
+    // Reading the last page of the file.
+    return readBlock(fHandle->totalNumPages - 1, fHandle, memPage);
 }
 
 extern RC writeBlock(int pageNum, SM_FileHandle *fHandle, SM_PageHandle memPage) {
-    // Check if the page number is within valid bounds
-    if (pageNum > fHandle->totalNumPages || pageNum < 0)
-        return RC_WRITE_FAILED;
+    SM_FileMgmt *mgmt = fileMgmt(fHandle);
+    RC rc = RC_OK;
 
-    // Open the file in read-write mode
-    FILE *file = fopen(fHandle->fileName, "r+");
+    // Check if the file handle is open
+    if (mgmt == NULL)
+        return RC_FILE_HANDLE_NOT_INIT;
+    if (pageNum < 0)
+        return RC_WRITE_FAILED;
 
-    // Check if the file opened successfully
-    if (file == NULL)
-        return RC_FILE_NOT_FOUND;
+    // Writing an existing page needs no lock, it does not change the size of the file
+    if (pageNum < __atomic_load_n(&fHandle->totalNumPages, __ATOMIC_RELAXED)) {
+        if (transferPage(mgmt, pageNum, memPage, 1) < PAGE_SIZE)
+            return RC_WRITE_FAILED;
+        setBlockPos(fHandle, pageNum);
+        return RC_OK;
+    }
 
-    // Calculate the starting position to write to the block
-    int writePosition = pageNum * PAGE_SIZE;
+    // Writing the page right after the last one appends it to the file, pages further out are rejected
+    pthread_mutex_lock(&mgmt->growLock);
+    if (pageNum > fHandle->totalNumPages)
+        rc = RC_WRITE_FAILED;
+    else if (transferPage(mgmt, pageNum, memPage, 1) < PAGE_SIZE)
+        rc = RC_WRITE_FAILED;
+    else if (pageNum == fHandle->totalNumPages)
+        __atomic_store_n(&fHandle->totalNumPages, pageNum + 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&mgmt->growLock);
+
+    if (rc == RC_OK)
+        setBlockPos(fHandle, pageNum);
+    return rc;
+}
 
-    if (pageNum == 0) {
-        // Write data directly to the specified page
-        
-		fseek(file, writePosition, SEEK_SET);
-        for (int i = 0; i < PAGE_SIZE; i++) {
-            // Append an empty block if the end of file is reached during writing
-            if (feof(file))
-                appendEmptyBlock(fHandle);
-            fputc(memPage[i], file);
-        }
+extern RC writeBlocks(int startPage, int count, SM_FileHandle *fHandle, SM_PageHandle *memPages) {
+    SM_FileMgmt *mgmt = fileMgmt(fHandle);
+    RC rc = RC_OK;
 
-        // Update the current position of the file handle
-        fHandle->curPagePos = ftell(file);
+    // Check if the file handle is open
+    if (mgmt == NULL)
+        return RC_FILE_HANDLE_NOT_INIT;
+    if (startPage < 0 || count < 0)
+        return RC_WRITE_FAILED;
+    if (count == 0)
+        return RC_OK;
 
-        // Close the file after writing
-        fclose(file);
-    } else {
-        // Handle writing to the first page separately
-        fHandle->curPagePos = writePosition;
-        fclose(file);
-        writeCurrentBlock(fHandle, memPage);
+    // A run inside the file needs no lock, it does not change the size of the file
+    if (startPage + count <= __atomic_load_n(&fHandle->totalNumPages, __ATOMIC_RELAXED)) {
+        if (transferPages(mgmt, startPage, count, memPages, 1) < count)
+            return RC_WRITE_FAILED;
+        setBlockPos(fHandle, startPage + count - 1);
+        return RC_OK;
     }
-    return RC_OK;
-}
-
 
+    // A run may extend the file if it starts at or before its end, like writeBlock
+    pthread_mutex_lock(&mgmt->growLock);
+    if (startPage > fHandle->totalNumPages)
+        rc = RC_WRITE_FAILED;
+    else if (transferPages(mgmt, startPage, count, memPages, 1) < count)
+        rc = RC_WRITE_FAILED;
+    else if (startPage + count > fHandle->totalNumPages)
+        __atomic_store_n(&fHandle->totalNumPages, startPage + count, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&mgmt->growLock);
+
+    if (rc == RC_OK)
+        setBlockPos(fHandle, startPage + count - 1);
+    return rc;
+}
 
 extern RC writeCurrentBlock(SM_FileHandle *fHandle, SM_PageHandle memPage) {
-    // Open the file in read-write mode to write to the current block
-    FILE *file = fopen(fHandle->fileName, "r+");
-
-    // Check if the file opened successfully
-    if (file == NULL)
-        return RC_FILE_NOT_FOUND;
-
-    // Add an empty block if needed before writing
-
-
-    appendEmptyBlock(fHandle);
-
-    // Move the file pointer to the current position
-    fseek(file, fHandle->curPagePos, SEEK_SET);
-
-    // Write the content of the memory page to the file
-    fwrite(memPage, sizeof(char), strlen(memPage), file);
-
-    // Update the file handle's current page position
-    fHandle->curPagePos = ftell(file);
-
-    // Close the file
-    fclose(file);
-    return RC_OK;
+    // Write the whole page at the current page position
+    return writeBlock(fHandle->curPagePos, fHandle, memPage);
 }
 
 extern RC appendEmptyBlock(SM_FileHandle *fHandle) {
-    // Allocate a blank page of size PAGE_SIZE bytes
-    SM_PageHandle emptyPage = (SM_PageHandle)calloc(PAGE_SIZE, sizeof(char));
-
-    // Move the file pointer to the end of the file
-    FILE *file = fopen(fHandle->fileName, "a+");
+    SM_FileMgmt *mgmt = fileMgmt(fHandle);
+    RC rc;
+
+    // Check if the file handle is open
+    if (mgmt == NULL)
+        return RC_FILE_HANDLE_NOT_INIT;
+
+    // Add one zeroed page at the end of the file
+    pthread_mutex_lock(&mgmt->growLock);
+    rc = growFile(fHandle, fHandle->totalNumPages + 1);
+    pthread_mutex_unlock(&mgmt->growLock);
+    return rc;
+}
 
-    // Write the empty page to the file to create space
-    if (fwrite(emptyPage, sizeof(char), PAGE_SIZE, file) != PAGE_SIZE) {
-        free(emptyPage);
-        fclose(file);
-        return RC_WRITE_FAILED;
-    }
+extern RC ensureCapacity(int numberOfPages, SM_FileHandle *fHandle) {
+    SM_FileMgmt *mgmt = fileMgmt(fHandle);
+    RC rc;
 
-    // Free the allocated memory for the empty page buffer
-    free(emptyPage);
+    // Check if the file handle is open
+    if (mgmt == NULL)
+        return RC_FILE_HANDLE_NOT_INIT;
 
-    // Increment the total number of pages in the file handle
-    fHandle->totalNumPages++;
+    // Most calls find the file large enough already and skip the lock
+    if (numberOfPages <= __atomic_load_n(&fHandle->totalNumPages, __ATOMIC_RELAXED))
+        return RC_OK;
 
-    // Close the file after appending
-    fclose(file);
-    return RC_OK;
+    // Add empty blocks until the total number of pages matches the required capacity
+    pthread_mutex_lock(&mgmt->growLock);
+    rc = growFile(fHandle, numberOfPages);
+    pthread_mutex_unlock(&mgmt->growLock);
+    return rc;
 }
 
-extern RC ensureCapacity(int numberOfPages, SM_FileHandle *fHandle) {
-    // Open the file in append mode to ensure capacity
-    FILE *file = fopen(fHandle->fileName, "a");
+extern RC reservePages(int numberOfPages, SM_FileHandle *fHandle) {
+    SM_FileMgmt *mgmt = fileMgmt(fHandle);
+    RC rc = RC_OK;
 
-    // Check if the file opened successfully
-    if (file == NULL)
-        return RC_FILE_NOT_FOUND;
-
-    // Add empty blocks until the total number of pages matches the required capacity
-    while (numberOfPages > fHandle->totalNumPages)
-        appendEmptyBlock(fHandle);
+    // Check if the file handle is open
+    if (mgmt == NULL)
+        return RC_FILE_HANDLE_NOT_INIT;
+    if (numberOfPages <= 0)
+        return RC_OK;
 
-    // Close the file stream after ensuring capacity
-    fclose(file);
-    return RC_OK;
+    // One fallocate allocates the holes below the end and grows the file if it is shorter.
+    // Filesystems that cannot preallocate get a sparse file, like ensureCapacity makes.
+    pthread_mutex_lock(&mgmt->growLock);
+    if (fallocate(mgmt->fd, 0, 0, pageOffset(numberOfPages)) == 0) {
+        if (numberOfPages > fHandle->totalNumPages)
+            __atomic_store_n(&fHandle->totalNumPages, numberOfPages, __ATOMIC_RELAXED);
+    } else if (errno == EOPNOTSUPP || errno == ENOSYS) {
+        rc = growFile(fHandle, numberOfPages);
+    } else {
+        rc = RC_WRITE_FAILED;
+    }
+    pthread_mutex_unlock(&mgmt->growLock);
+    return rc;
 }
@@ -22,6 +22,12 @@ typedef char* SM_PageHandle;
 extern void initStorageManager (void);
 extern RC createPageFile (char *fileName);
 extern RC openPageFile (char *fileName, SM_FileHandle *fHandle);
+/* like openPageFile, but bypasses the kernel page cache with O_DIRECT where the
+ * filesystem supports it. Blocks are PAGE_SIZE aligned, unaligned buffers are copied. */
+extern RC openPageFileDirect (char *fileName, SM_FileHandle *fHandle);
+extern int isDirectIO (SM_FileHandle *fHandle);
+/* descriptor of an open page file, for asynchronous I/O on the same file */
+extern int getFileDescriptor (SM_FileHandle *fHandle);
 extern RC closePageFile (SM_FileHandle *fHandle);
 extern RC destroyPageFile (char *fileName);
 
@@ -33,11 +39,18 @@ extern RC readPreviousBlock (SM_FileHandle *fHandle, SM_PageHandle memPage);
 extern RC readCurrentBlock (SM_FileHandle *fHandle, SM_PageHandle memPage);
 extern RC readNextBlock (SM_FileHandle *fHandle, SM_PageHandle memPage);
 extern RC readLastBlock (SM_FileHandle *fHandle, SM_PageHandle memPage);
+/* count consecutive pages from startPage into memPages[0..count-1], with one preadv per IOV_MAX pages */
+extern RC readBlocks (int startPage, int count, SM_FileHandle *fHandle, SM_PageHandle *memPages);
 
 /* writing blocks to a page file */
 extern RC writeBlock (int pageNum, SM_FileHandle *fHandle, SM_PageHandle memPage);
 extern RC writeCurrentBlock (SM_FileHandle *fHandle, SM_PageHandle memPage);
+/* count consecutive pages from memPages[0..count-1] starting at startPage, with pwritev */
+extern RC writeBlocks (int startPage, int count, SM_FileHandle *fHandle, SM_PageHandle *memPages);
 extern RC appendEmptyBlock (SM_FileHandle *fHandle);
 extern RC ensureCapacity (int numberOfPages, SM_FileHandle *fHandle);
+/* like ensureCapacity, but also allocates disk space for the first numberOfPages pages
+ * with fallocate, so bulk loads neither run out of space midway nor fragment the file */
+extern RC reservePages (int numberOfPages, SM_FileHandle *fHandle);
 
 #endif
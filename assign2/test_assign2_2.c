@@ -7,6 +7,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
+#include <unistd.h>
 
 // var to store the current test's name
 char *testName;
@@ -31,7 +33,29 @@ free(real);                                \
 // test and helper methods
 static void createDummyPages(BM_BufferPool *bm, int num);
 
+static void testTwoPools (void);
+static void testConcurrentPins (void);
+static void *concurrentPinWorker (void *arg);
+static void testOptimisticRead (void);
+static void testDirectIO (void);
+static void testFlushEngines (void);
+static void testMultiPageIO (void);
+static void testMappedPool (void);
+static void testFileGrowth (void);
+
+static void testLFU (void);
 static void testLRU_K (void);
+static void testARC (void);
+static void test2Q (void);
+static void testAdmissionFilter (void);
+static void testCustomPolicy (void);
+static void testScanRing (void);
+static void testReadAhead (void);
+static void testPrefetcher (void);
+static void testPrefetchPages (void);
+static void testBackgroundWriter (void);
+static void changePages (BM_BufferPool *bm, BM_PageHandle *h, PageNumber from, PageNumber to);
+static void testLRU_KScan (void);
 
 static void testError (void);
 
@@ -42,7 +66,26 @@ main (void)
     initStorageManager();
     testName = "";
     
+    testTwoPools();
+    testConcurrentPins();
+    testOptimisticRead();
+    testDirectIO();
+    testFlushEngines();
+    testMultiPageIO();
+    testMappedPool();
+    testFileGrowth();
+    testLFU();
     testLRU_K();
+    testARC();
+    test2Q();
+    testAdmissionFilter();
+    testCustomPolicy();
+    testScanRing();
+    testReadAhead();
+    testPrefetcher();
+    testPrefetchPages();
+    testBackgroundWriter();
+    testLRU_KScan();
     testError();
     return 0;
 }
@@ -69,6 +112,900 @@ createDummyPages(BM_BufferPool *bm, int num)
     free(h);
 }
 
+// two pools opened side by side must keep their own contents and I/O counters
+void
+testTwoPools (void)
+{
+    BM_BufferPool *bm1 = MAKE_POOL();
+    BM_BufferPool *bm2 = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    int i;
+    testName = "Testing two buffer pools at once";
+    
+    CHECK(createPageFile("testbuffer.bin"));
+    CHECK(createPageFile("testbuffer2.bin"));
+    createDummyPages(bm1, 10);
+    CHECK(initBufferPool(bm1, "testbuffer.bin", 3, RS_FIFO, NULL));
+    CHECK(initBufferPool(bm2, "testbuffer2.bin", 2, RS_LRU, NULL));
+    
+    for (i = 0; i < 5; i++)
+    {
+        CHECK(pinPage(bm1, h, i));
+        CHECK(unpinPage(bm1, h));
+    }
+    CHECK(pinPage(bm2, h, 0));
+    CHECK(markDirty(bm2, h));
+    CHECK(unpinPage(bm2, h));
+    
+    ASSERT_EQUALS_POOL("[3 0],[4 0],[2 0]", bm1, "first pool keeps its FIFO state");
+    ASSERT_EQUALS_POOL("[0x0],[-1 0]", bm2, "second pool only holds its own page");
+    
+    CHECK(forceFlushPool(bm2));
+    ASSERT_EQUALS_INT(5, getNumReadIO(bm1), "read I/Os of the first pool");
+    ASSERT_EQUALS_INT(0, getNumWriteIO(bm1), "write I/Os of the first pool");
+    ASSERT_EQUALS_INT(1, getNumReadIO(bm2), "read I/Os of the second pool");
+    ASSERT_EQUALS_INT(1, getNumWriteIO(bm2), "write I/Os of the second pool");
+    
+    CHECK(shutdownBufferPool(bm1));
+    CHECK(shutdownBufferPool(bm2));
+    CHECK(destroyPageFile("testbuffer.bin"));
+    CHECK(destroyPageFile("testbuffer2.bin"));
+    
+    free(bm1);
+    free(bm2);
+    free(h);
+    TEST_DONE();
+}
+
+// pool and counters shared by the threads of testConcurrentPins
+#define CONCURRENT_THREADS 4
+#define CONCURRENT_PAGES 64
+#define CONCURRENT_PINS 5000
+
+static BM_BufferPool *concurrentPool;
+static int concurrentErrors;
+static pthread_mutex_t concurrentErrorsLock = PTHREAD_MUTEX_INITIALIZER;
+
+// several threads pin random pages of a small concurrent pool and check what they read
+void
+testConcurrentPins (void)
+{
+    BM_PoolOptions options;
+    pthread_t threads[CONCURRENT_THREADS];
+    unsigned int seeds[CONCURRENT_THREADS];
+    int *fixCounts;
+    int i;
+    testName = "Testing concurrent pins";
+    
+    concurrentPool = MAKE_POOL();
+    concurrentErrors = 0;
+    CHECK(createPageFile("testbuffer.bin"));
+    createDummyPages(concurrentPool, CONCURRENT_PAGES);
+    
+    initPoolOptions(&options);
+    options.concurrent = true;
+    options.numPartitions = 4;
+    CHECK(initBufferPoolWithOptions(concurrentPool, "testbuffer.bin", 16, RS_LRU, NULL, &options));
+    
+    for (i = 0; i < CONCURRENT_THREADS; i++)
+    {
+        seeds[i] = i + 1;
+        pthread_create(&threads[i], NULL, concurrentPinWorker, &seeds[i]);
+    }
+    for (i = 0; i < CONCURRENT_THREADS; i++)
+        pthread_join(threads[i], NULL);
+    
+    ASSERT_EQUALS_INT(0, concurrentErrors, "every pin returned the right page");
+    fixCounts = getFixCounts(concurrentPool);
+    for (i = 0; i < 16; i++)
+        ASSERT_EQUALS_INT(0, fixCounts[i], "no frame is left pinned");
+    free(fixCounts);
+    
+    CHECK(shutdownBufferPool(concurrentPool));
+    CHECK(destroyPageFile("testbuffer.bin"));
+    free(concurrentPool);
+    TEST_DONE();
+}
+
+void *
+concurrentPinWorker (void *arg)
+{
+    unsigned int *seed = (unsigned int *) arg;
+    BM_PageHandle h;
+    char expected[32];
+    int i, errors = 0;
+    
+    for (i = 0; i < CONCURRENT_PINS; i++)
+    {
+        PageNumber pageNum = rand_r(seed) % CONCURRENT_PAGES;
+        
+        if (pinPage(concurrentPool, &h, pageNum) != RC_OK)
+        {
+            errors++;
+            continue;
+        }
+        sprintf(expected, "%s-%i", "Page", pageNum);
+        if (h.pageNum != pageNum || strcmp(expected, h.data) != 0)
+            errors++;
+        if (unpinPage(concurrentPool, &h) != RC_OK)
+            errors++;
+    }
+    
+    pthread_mutex_lock(&concurrentErrorsLock);
+    concurrentErrors += errors;
+    pthread_mutex_unlock(&concurrentErrorsLock);
+    return NULL;
+}
+
+// optimistic reads validate only if no writer and no replacement overlapped them
+void
+testOptimisticRead (void)
+{
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    BM_PageHandle *w = MAKE_PAGE_HANDLE();
+    BM_PoolOptions options;
+    BM_ReadToken token;
+    testName = "Testing shared, exclusive and optimistic pins";
+    
+    CHECK(createPageFile("testbuffer.bin"));
+    createDummyPages(bm, 10);
+    initPoolOptions(&options);
+    options.concurrent = true;
+    CHECK(initBufferPoolWithOptions(bm, "testbuffer.bin", 2, RS_FIFO, NULL, &options));
+    
+    // an undisturbed read validates and leaves the page unpinned
+    CHECK(pinPageOptimistic(bm, h, 1, &token));
+    ASSERT_EQUALS_STRING("Page-1", h->data, "optimistic read sees the page");
+    ASSERT_EQUALS_POOL("[1 0],[-1 0]", bm, "optimistic read does not pin");
+    CHECK(unpinPageOptimistic(bm, h, &token));
+    
+    // shared pins can be stacked and do not disturb optimistic readers
+    CHECK(pinPageOptimistic(bm, h, 1, &token));
+    CHECK(pinPageShared(bm, w, 1));
+    CHECK(pinPageShared(bm, w, 1));
+    ASSERT_EQUALS_POOL("[1 2],[-1 0]", bm, "two shared pins");
+    CHECK(unpinPageShared(bm, w));
+    CHECK(unpinPageShared(bm, w));
+    CHECK(unpinPageOptimistic(bm, h, &token));
+    
+    // an exclusive pin in between invalidates the read
+    CHECK(pinPageOptimistic(bm, h, 1, &token));
+    CHECK(pinPageExclusive(bm, w, 1));
+    sprintf(w->data, "%s-%i", "Changed", 1);
+    CHECK(markDirty(bm, w));
+    CHECK(unpinPageExclusive(bm, w));
+    ASSERT_ERROR(unpinPageOptimistic(bm, h, &token), "read overlapped an exclusive pin");
+    
+    // so does replacing the page
+    CHECK(pinPageOptimistic(bm, h, 1, &token));
+    CHECK(pinPage(bm, w, 2));
+    CHECK(unpinPage(bm, w));
+    CHECK(pinPage(bm, w, 3));
+    CHECK(unpinPage(bm, w));
+    ASSERT_ERROR(unpinPageOptimistic(bm, h, &token), "page was replaced during the read");
+    
+    CHECK(shutdownBufferPool(bm));
+    CHECK(destroyPageFile("testbuffer.bin"));
+    free(bm);
+    free(h);
+    free(w);
+    TEST_DONE();
+}
+
+// pages written by a pool in direct I/O mode must read back through a buffered and a direct handle
+void
+testDirectIO (void)
+{
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    BM_PoolOptions options;
+    SM_FileHandle fh;
+    char *page = malloc(PAGE_SIZE + 1);
+    char expected[16];
+    int i;
+    testName = "Testing direct I/O";
+    
+    CHECK(createPageFile("testbuffer.bin"));
+    initPoolOptions(&options);
+    options.directIO = true;
+    CHECK(initBufferPoolWithOptions(bm, "testbuffer.bin", 3, RS_FIFO, NULL, &options));
+    for (i = 0; i < 10; i++)
+    {
+        CHECK(pinPage(bm, h, i));
+        sprintf(h->data, "%s-%i", "Page", h->pageNum);
+        CHECK(markDirty(bm, h));
+        CHECK(unpinPage(bm, h));
+    }
+    CHECK(shutdownBufferPool(bm));
+    
+    CHECK(initBufferPool(bm, "testbuffer.bin", 3, RS_FIFO, NULL));
+    CHECK(pinPage(bm, h, 7));
+    ASSERT_EQUALS_STRING("Page-7", h->data, "buffered pool reads a page written directly");
+    CHECK(unpinPage(bm, h));
+    CHECK(shutdownBufferPool(bm));
+    
+    // an unaligned buffer still works on a direct handle
+    CHECK(openPageFileDirect("testbuffer.bin", &fh));
+    for (i = 0; i < 10; i++)
+    {
+        sprintf(expected, "%s-%i", "Page", i);
+        CHECK(readBlock(i, &fh, page + 1));
+        ASSERT_EQUALS_STRING(expected, page + 1, "direct handle reads into an unaligned buffer");
+    }
+    CHECK(closePageFile(&fh));
+    CHECK(destroyPageFile("testbuffer.bin"));
+    
+    free(page);
+    free(bm);
+    free(h);
+    TEST_DONE();
+}
+
+// a flush queues all dirty pages on the I/O engine at once, with io_uring and with worker threads
+void
+testFlushEngines (void)
+{
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    BM_PoolOptions options;
+    IO_EngineKind kinds[] = { IO_ENGINE_AUTO, IO_ENGINE_THREADS };
+    char expected[16];
+    int i, k;
+    testName = "Testing batched flushes on both I/O engines";
+    
+    for (k = 0; k < 2; k++)
+    {
+        CHECK(createPageFile("testbuffer.bin"));
+        initPoolOptions(&options);
+        options.concurrent = true;
+        options.ioEngine = kinds[k];
+        CHECK(initBufferPoolWithOptions(bm, "testbuffer.bin", 64, RS_FIFO, NULL, &options));
+        for (i = 0; i < 64; i++)
+        {
+            CHECK(pinPage(bm, h, i));
+            sprintf(h->data, "%s-%i", "Page", h->pageNum);
+            CHECK(markDirty(bm, h));
+            CHECK(unpinPage(bm, h));
+        }
+        CHECK(forceFlushPool(bm));
+        ASSERT_EQUALS_INT(64, getNumReadIO(bm), "every page read once");
+        ASSERT_EQUALS_INT(64, getNumWriteIO(bm), "every dirty page written by the flush");
+        CHECK(forceFlushPool(bm));
+        ASSERT_EQUALS_INT(64, getNumWriteIO(bm), "clean pages are not written again");
+        CHECK(shutdownBufferPool(bm));
+        
+        CHECK(initBufferPool(bm, "testbuffer.bin", 3, RS_FIFO, NULL));
+        for (i = 0; i < 64; i += 9)
+        {
+            sprintf(expected, "%s-%i", "Page", i);
+            CHECK(pinPage(bm, h, i));
+            ASSERT_EQUALS_STRING(expected, h->data, "flushed page reads back");
+            CHECK(unpinPage(bm, h));
+        }
+        CHECK(shutdownBufferPool(bm));
+        CHECK(destroyPageFile("testbuffer.bin"));
+    }
+    
+    free(bm);
+    free(h);
+    TEST_DONE();
+}
+
+// runs of pages move with one vectored call from and to buffers scattered in memory
+void
+testMultiPageIO (void)
+{
+    SM_FileHandle fh;
+    SM_PageHandle pages[5];
+    char expected[16];
+    int i;
+    testName = "Testing multi-page reads and writes";
+    
+    CHECK(createPageFile("testbuffer.bin"));
+    CHECK(openPageFile("testbuffer.bin", &fh));
+    for (i = 0; i < 5; i++)
+    {
+        pages[i] = calloc(PAGE_SIZE, 1);
+        sprintf(pages[i], "%s-%i", "Page", i + 1);
+    }
+    CHECK(writeBlocks(1, 5, &fh, pages));
+    ASSERT_EQUALS_INT(6, fh.totalNumPages, "run appended after page 0");
+    ASSERT_ERROR(writeBlocks(7, 5, &fh, pages), "run may not leave a gap after the end");
+    
+    for (i = 0; i < 5; i++)
+        memset(pages[i], 0, PAGE_SIZE);
+    CHECK(readBlocks(2, 4, &fh, pages));
+    for (i = 0; i < 4; i++)
+    {
+        sprintf(expected, "%s-%i", "Page", i + 2);
+        ASSERT_EQUALS_STRING(expected, pages[i], "page of the run reads back");
+    }
+    ASSERT_EQUALS_INT(5, getBlockPos(&fh), "position is the last page read");
+    ASSERT_ERROR(readBlocks(3, 5, &fh, pages), "run past the end of the file");
+    
+    CHECK(closePageFile(&fh));
+    CHECK(destroyPageFile("testbuffer.bin"));
+    for (i = 0; i < 5; i++)
+        free(pages[i]);
+    TEST_DONE();
+}
+
+// an mmap pool hands out pages inside the mapping, writes reach the file through msync
+void
+testMappedPool (void)
+{
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    BM_PoolOptions options;
+    char *first;
+    testName = "Testing memory mapped pools";
+    
+    CHECK(createPageFile("testbuffer.bin"));
+    createDummyPages(bm, 10);
+    initPoolOptions(&options);
+    options.mmapPages = true;
+    CHECK(initBufferPoolWithOptions(bm, "testbuffer.bin", 3, RS_FIFO, NULL, &options));
+    
+    CHECK(pinPage(bm, h, 2));
+    ASSERT_EQUALS_STRING("Page-2", h->data, "page read through the mapping");
+    first = h->data;
+    CHECK(pinPage(bm, h, 3));
+    ASSERT_TRUE(h->data == first + PAGE_SIZE, "pages point into one mapping");
+    CHECK(unpinPage(bm, h));
+    h->pageNum = 2;
+    CHECK(unpinPage(bm, h));
+    
+    CHECK(pinPage(bm, h, 4));
+    sprintf(h->data, "%s-%i", "Mapped", 4);
+    CHECK(markDirty(bm, h));
+    CHECK(forcePage(bm, h));
+    ASSERT_EQUALS_INT(1, getNumWriteIO(bm), "forcePage syncs one page");
+    CHECK(unpinPage(bm, h));
+    
+    // pages past the end grow the file and the mapping
+    CHECK(pinPage(bm, h, 20));
+    ASSERT_EQUALS_INT(0, h->data[0], "new page is empty");
+    sprintf(h->data, "%s-%i", "Mapped", 20);
+    CHECK(markDirty(bm, h));
+    CHECK(unpinPage(bm, h));
+    CHECK(shutdownBufferPool(bm));
+    
+    CHECK(initBufferPool(bm, "testbuffer.bin", 3, RS_FIFO, NULL));
+    CHECK(pinPage(bm, h, 4));
+    ASSERT_EQUALS_STRING("Mapped-4", h->data, "synced page reads back");
+    CHECK(unpinPage(bm, h));
+    CHECK(pinPage(bm, h, 20));
+    ASSERT_EQUALS_STRING("Mapped-20", h->data, "page flushed at shutdown reads back");
+    CHECK(unpinPage(bm, h));
+    CHECK(shutdownBufferPool(bm));
+    CHECK(destroyPageFile("testbuffer.bin"));
+    
+    free(bm);
+    free(h);
+    TEST_DONE();
+}
+
+// files grow by many pages in one step, with or without reserving disk space
+void
+testFileGrowth (void)
+{
+    SM_FileHandle fh;
+    SM_PageHandle page = malloc(PAGE_SIZE);
+    testName = "Testing file growth and page reservation";
+    
+    CHECK(createPageFile("testbuffer.bin"));
+    CHECK(openPageFile("testbuffer.bin", &fh));
+    CHECK(ensureCapacity(100000, &fh));
+    ASSERT_EQUALS_INT(100000, fh.totalNumPages, "file grown to 100000 pages");
+    memset(page, 'x', PAGE_SIZE);
+    CHECK(readBlock(99999, &fh, page));
+    ASSERT_EQUALS_INT(0, page[PAGE_SIZE - 1], "new pages read back as zeros");
+    CHECK(reservePages(50, &fh));
+    ASSERT_EQUALS_INT(100000, fh.totalNumPages, "reserving existing pages keeps the size");
+    CHECK(reservePages(100010, &fh));
+    ASSERT_EQUALS_INT(100010, fh.totalNumPages, "reserving past the end grows the file");
+    CHECK(appendEmptyBlock(&fh));
+    ASSERT_EQUALS_INT(100011, fh.totalNumPages, "append adds one page");
+    CHECK(closePageFile(&fh));
+    
+    CHECK(openPageFile("testbuffer.bin", &fh));
+    ASSERT_EQUALS_INT(100011, fh.totalNumPages, "size survives reopening");
+    CHECK(closePageFile(&fh));
+    CHECK(destroyPageFile("testbuffer.bin"));
+    free(page);
+    TEST_DONE();
+}
+
+// pins the page and unpins it again, times times
+static void
+touchPage (BM_BufferPool *bm, BM_PageHandle *h, PageNumber pageNum, int times)
+{
+    int i;
+    
+    for (i = 0; i < times; i++)
+    {
+        CHECK(pinPage(bm, h, pageNum));
+        CHECK(unpinPage(bm, h));
+    }
+}
+
+// LFU evicts the least used unpinned page, and halving the counts lets old favourites go
+void
+testLFU (void)
+{
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    BM_PageHandle *pinned = MAKE_PAGE_HANDLE();
+    BM_LFUParams params = { 10 };
+    testName = "Testing LFU page replacement";
+    
+    CHECK(createPageFile("testbuffer.bin"));
+    CHECK(initBufferPool(bm, "testbuffer.bin", 3, RS_LFU, NULL));
+    touchPage(bm, h, 0, 3);
+    touchPage(bm, h, 1, 2);
+    touchPage(bm, h, 2, 1);
+    touchPage(bm, h, 3, 1);
+    ASSERT_EQUALS_POOL("[0 0],[1 0],[3 0]", bm, "least used page replaced");
+    touchPage(bm, h, 4, 1);
+    ASSERT_EQUALS_POOL("[0 0],[1 0],[4 0]", bm, "least recently used among the least used pages");
+    CHECK(pinPage(bm, pinned, 4));
+    touchPage(bm, h, 5, 1);
+    ASSERT_EQUALS_POOL("[0 0],[5 0],[4 1]", bm, "pinned page is skipped");
+    CHECK(unpinPage(bm, pinned));
+    CHECK(shutdownBufferPool(bm));
+    
+    // pinned pages wait outside the candidates and join them with their last unpin, so
+    // page 0, held while pages 1 and 2 came and went, is the last to go of the three
+    CHECK(initBufferPool(bm, "testbuffer.bin", 3, RS_LFU, NULL));
+    CHECK(pinPage(bm, pinned, 0));
+    touchPage(bm, h, 1, 1);
+    touchPage(bm, h, 2, 1);
+    CHECK(unpinPage(bm, pinned));
+    touchPage(bm, h, 3, 1);
+    ASSERT_EQUALS_POOL("[0 0],[3 0],[2 0]", bm, "page unpinned last kept among pages used as often");
+    CHECK(shutdownBufferPool(bm));
+    
+    // page 0 counts 6 and page 1 counts 4 when the counts are halved to 3 and 2, one more
+    // use of page 1 makes it as frequent as page 0, which was used longer ago
+    CHECK(initBufferPool(bm, "testbuffer.bin", 2, RS_LFU, &params));
+    touchPage(bm, h, 0, 6);
+    touchPage(bm, h, 1, 4);
+    touchPage(bm, h, 1, 1);
+    touchPage(bm, h, 2, 1);
+    ASSERT_EQUALS_POOL("[2 0],[1 0]", bm, "aged page replaced");
+    CHECK(shutdownBufferPool(bm));
+    CHECK(destroyPageFile("testbuffer.bin"));
+    
+    free(bm);
+    free(h);
+    free(pinned);
+    TEST_DONE();
+}
+
+// ARC keeps pages used twice through a scan, and a miss on a page the scan pushed out
+// recently gives the pages used once more room
+void
+testARC (void)
+{
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    int i;
+    testName = "Testing ARC page replacement";
+    
+    CHECK(createPageFile("testbuffer.bin"));
+    CHECK(initBufferPool(bm, "testbuffer.bin", 3, RS_ARC, NULL));
+    touchPage(bm, h, 0, 2);
+    touchPage(bm, h, 1, 2);
+    for (i = 10; i < 20; i++)
+        touchPage(bm, h, i, 1);
+    ASSERT_EQUALS_POOL("[0 0],[1 0],[19 0]", bm, "scan only replaced pages used once");
+    
+    // 18 is remembered, so its miss grows the share of pages used once at the cost of page 0
+    touchPage(bm, h, 18, 1);
+    ASSERT_EQUALS_POOL("[18 0],[1 0],[19 0]", bm, "recently evicted page came back");
+    CHECK(shutdownBufferPool(bm));
+    CHECK(destroyPageFile("testbuffer.bin"));
+    
+    free(bm);
+    free(h);
+    TEST_DONE();
+}
+
+// 2Q moves a page into its main list when it comes back soon after leaving A1in, and a
+// scan then only replaces pages of A1in
+void
+test2Q (void)
+{
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    BM_2QParams params = { 1, 4 };
+    int i;
+    testName = "Testing 2Q page replacement";
+    
+    CHECK(createPageFile("testbuffer.bin"));
+    CHECK(initBufferPool(bm, "testbuffer.bin", 4, RS_2Q, &params));
+    for (i = 0; i < 5; i++)
+        touchPage(bm, h, i, 1);
+    ASSERT_EQUALS_POOL("[4 0],[1 0],[2 0],[3 0]", bm, "oldest page of A1in replaced");
+    touchPage(bm, h, 0, 1);
+    ASSERT_EQUALS_POOL("[4 0],[0 0],[2 0],[3 0]", bm, "remembered page came back");
+    for (i = 10; i < 20; i++)
+        touchPage(bm, h, i, 1);
+    ASSERT_EQUALS_POOL("[18 0],[0 0],[19 0],[17 0]", bm, "scan only replaced pages of A1in");
+    CHECK(shutdownBufferPool(bm));
+    CHECK(destroyPageFile("testbuffer.bin"));
+    
+    free(bm);
+    free(h);
+    TEST_DONE();
+}
+
+// a page seen less often than the victim is served from the bypass frame and not cached,
+// until it has been used more often than the page it would replace
+void
+testAdmissionFilter (void)
+{
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    BM_PoolOptions options;
+    BM_ReadToken token;
+    testName = "Testing the TinyLFU admission filter";
+    
+    initPoolOptions(&options);
+    options.admissionFilter = true;
+    CHECK(createPageFile("testbuffer.bin"));
+    CHECK(initBufferPoolWithOptions(bm, "testbuffer.bin", 3, RS_LRU, NULL, &options));
+    touchPage(bm, h, 0, 3);
+    touchPage(bm, h, 1, 3);
+    touchPage(bm, h, 2, 3);
+    
+    CHECK(pinPage(bm, h, 10));
+    ASSERT_EQUALS_POOL("[0 0],[1 0],[2 0]", bm, "page seen once is not admitted");
+    sprintf(h->data, "%s-%i", "Page", 10);
+    CHECK(markDirty(bm, h));
+    CHECK(unpinPage(bm, h));
+    ASSERT_EQUALS_INT(1, getNumWriteIO(bm), "changed page written back by its last unpin");
+    CHECK(pinPage(bm, h, 10));
+    ASSERT_EQUALS_STRING("Page-10", h->data, "page read back through the bypass frame");
+    CHECK(unpinPage(bm, h));
+    
+    // an optimistic read of a page turned away keeps the bypass frame until it ends
+    CHECK(pinPageOptimistic(bm, h, 10, &token));
+    ASSERT_EQUALS_STRING("Page-10", h->data, "optimistic read through the bypass frame");
+    ASSERT_EQUALS_POOL("[0 0],[1 0],[2 0]", bm, "page still not admitted");
+    CHECK(unpinPageOptimistic(bm, h, &token));
+    
+    touchPage(bm, h, 10, 2);
+    ASSERT_EQUALS_POOL("[10 0],[1 0],[2 0]", bm, "page admitted once used more than the victim");
+    CHECK(shutdownBufferPool(bm));
+    CHECK(destroyPageFile("testbuffer.bin"));
+    
+    free(bm);
+    free(h);
+    TEST_DONE();
+}
+
+// a sequential scan recycles the frames of the scan ring, an eighth of the pool here,
+// and leaves the other pages in the pool
+void
+testScanRing (void)
+{
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    int i, reads;
+    testName = "Testing the sequential scan ring";
+    
+    CHECK(createPageFile("testbuffer.bin"));
+    CHECK(initBufferPool(bm, "testbuffer.bin", 16, RS_LRU, NULL));
+    for (i = 0; i < 16; i++)
+        touchPage(bm, h, i, 1);
+    for (i = 100; i < 140; i++)
+    {
+        CHECK(pinPageWithHint(bm, h, i, BM_ACCESS_SEQUENTIAL));
+        CHECK(unpinPage(bm, h));
+    }
+    ASSERT_EQUALS_POOL("[138 0],[139 0],[2 0],[3 0],[4 0],[5 0],[6 0],[7 0],[8 0],[9 0],[10 0],[11 0],[12 0],[13 0],[14 0],[15 0]",
+                       bm, "scan only replaced the frames of its ring");
+    reads = getNumReadIO(bm);
+    for (i = 2; i < 16; i++)
+        touchPage(bm, h, i, 1);
+    ASSERT_EQUALS_INT(reads, getNumReadIO(bm), "working set still in the pool");
+    CHECK(shutdownBufferPool(bm));
+    CHECK(destroyPageFile("testbuffer.bin"));
+    
+    free(bm);
+    free(h);
+    TEST_DONE();
+}
+
+// pins walking the file in order find the next pages read ahead, random pins stop the
+// stream, and pages read ahead for nothing are counted once they are replaced
+void
+testReadAhead (void)
+{
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    BM_PageHandle held[16];
+    BM_PoolOptions options;
+    char expected[16];
+    int i;
+    testName = "Testing sequential read-ahead";
+    
+    CHECK(createPageFile("testbuffer.bin"));
+    createDummyPages(bm, 64);
+    initPoolOptions(&options);
+    options.readAhead = true;
+    CHECK(initBufferPoolWithOptions(bm, "testbuffer.bin", 16, RS_LRU, NULL, &options));
+    for (i = 0; i < 32; i++)
+    {
+        CHECK(pinPage(bm, h, i));
+        sprintf(expected, "%s-%i", "Page", i);
+        if (strcmp(expected, h->data) != 0)
+        {
+            ASSERT_EQUALS_STRING(expected, h->data, "page read ahead holds its data");
+        }
+        CHECK(unpinPage(bm, h));
+    }
+    ASSERT_EQUALS_INT(30, getNumPrefetchHits(bm), "every page after the first two was read ahead");
+    ASSERT_EQUALS_INT(0, getNumPrefetchWasted(bm), "nothing read ahead was replaced unused");
+    
+    for (i = 0; i < 16; i++)
+        touchPage(bm, h, 40 + (i * 7) % 24, 1);
+    ASSERT_EQUALS_INT(30, getNumPrefetchHits(bm), "random pins read nothing ahead");
+    ASSERT_EQUALS_INT(4, getNumPrefetchWasted(bm), "pages 32 to 35 read ahead past the stream, replaced unused");
+    
+    // a stream that stops early does not keep the frames it read ahead, even when they are
+    // the only ones left and no pin waits for their reads
+    for (i = 0; i < 12; i++)
+        CHECK(pinPage(bm, &held[i], 40 + i));
+    CHECK(pinPage(bm, &held[12], 0));
+    CHECK(pinPage(bm, &held[13], 1));
+    usleep(100000);
+    CHECK(pinPage(bm, &held[14], 100));
+    CHECK(pinPage(bm, &held[15], 101));
+    for (i = 0; i < 16; i++)
+        CHECK(unpinPage(bm, &held[i]));
+    CHECK(shutdownBufferPool(bm));
+    CHECK(destroyPageFile("testbuffer.bin"));
+    
+    free(bm);
+    free(h);
+    TEST_DONE();
+}
+
+// writes "Changed-<page>" into the pages from .. to-1 and marks them dirty
+static void
+changePages (BM_BufferPool *bm, BM_PageHandle *h, PageNumber from, PageNumber to)
+{
+    PageNumber p;
+    
+    for (p = from; p < to; p++)
+    {
+        CHECK(pinPage(bm, h, p));
+        sprintf(h->data, "%s-%i", "Changed", p);
+        CHECK(markDirty(bm, h));
+        CHECK(unpinPage(bm, h));
+    }
+}
+
+// the background writer cleans dirty pages before they are replaced, so misses need not write
+void
+testBackgroundWriter (void)
+{
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    BM_PoolOptions options;
+    char expected[24];
+    int i, waited;
+    testName = "Testing the background writer";
+    
+    CHECK(createPageFile("testbuffer.bin"));
+    createDummyPages(bm, 32);
+    initPoolOptions(&options);
+    CHECK(initBufferPoolWithOptions(bm, "testbuffer.bin", 8, RS_LRU, NULL, &options));
+    changePages(bm, h, 0, 8);
+    for (i = 8; i < 16; i++)
+        touchPage(bm, h, i, 1);
+    ASSERT_EQUALS_INT(8, getNumSyncWrites(bm), "without the writer every miss wrote its victim");
+    CHECK(shutdownBufferPool(bm));
+    
+    options.backgroundWriter = true;
+    options.bgWriterDelay = 10;
+    CHECK(initBufferPoolWithOptions(bm, "testbuffer.bin", 8, RS_LRU, NULL, &options));
+    changePages(bm, h, 16, 24);
+    for (waited = 0; getNumWriteIO(bm) < 8 && waited < 5000; waited += 10)
+        usleep(10000);
+    // waits for the round of the writer to end
+    CHECK(forceFlushPool(bm));
+    ASSERT_EQUALS_INT(8, getNumWriteIO(bm), "the writer wrote every dirty page");
+    ASSERT_EQUALS_POOL("[16 0],[17 0],[18 0],[19 0],[20 0],[21 0],[22 0],[23 0]", bm, "the pages are clean again");
+    for (i = 24; i < 32; i++)
+        touchPage(bm, h, i, 1);
+    ASSERT_EQUALS_INT(0, getNumSyncWrites(bm), "no miss had to write its victim");
+    for (i = 0; i < 24; i += (i == 7) ? 9 : 1)
+    {
+        CHECK(pinPage(bm, h, i));
+        sprintf(expected, "%s-%i", "Changed", i);
+        ASSERT_EQUALS_STRING(expected, h->data, "changed page reached the disk");
+        CHECK(unpinPage(bm, h));
+    }
+    CHECK(shutdownBufferPool(bm));
+    CHECK(destroyPageFile("testbuffer.bin"));
+    
+    free(bm);
+    free(h);
+    TEST_DONE();
+}
+
+// pages prefetched by the caller are loaded unpinned, and pins of them are hits
+void
+testPrefetchPages (void)
+{
+    const PageNumber pages[] = { 9, 3, 12 };
+    const PageNumber beyond[] = { 5, 20 };
+    const PageNumber negative[] = { -1 };
+    const PageNumber whole[] = { 0, 1, 2, 4 };
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    char expected[16];
+    int i;
+    testName = "Testing explicit prefetching";
+    
+    CHECK(createPageFile("testbuffer.bin"));
+    createDummyPages(bm, 16);
+    CHECK(initBufferPool(bm, "testbuffer.bin", 4, RS_LRU, NULL));
+    CHECK(prefetchPages(bm, pages, 3));
+    ASSERT_EQUALS_POOL("[9 0],[3 0],[12 0],[-1 0]", bm, "prefetched pages are loaded but not pinned");
+    for (i = 2; i >= 0; i--)
+    {
+        CHECK(pinPage(bm, h, pages[i]));
+        sprintf(expected, "%s-%i", "Page", pages[i]);
+        ASSERT_EQUALS_STRING(expected, h->data, "prefetched page holds its data");
+        CHECK(unpinPage(bm, h));
+    }
+    ASSERT_EQUALS_INT(3, getNumReadIO(bm), "every page was read once");
+    ASSERT_EQUALS_INT(3, getNumPrefetchHits(bm), "every pin found its page prefetched");
+    
+    touchPage(bm, h, 5, 1);
+    CHECK(prefetchPages(bm, beyond, 2));
+    ASSERT_EQUALS_POOL("[9 0],[3 0],[12 0],[5 0]", bm, "resident pages and pages past the end are skipped");
+    ASSERT_EQUALS_INT(4, getNumReadIO(bm), "nothing more was read");
+    ASSERT_ERROR(prefetchPages(bm, negative, 1), "negative page numbers are rejected");
+    
+    // prefetched pages nobody pins give their frames back once they arrived, whether the
+    // pin comes while they are in flight or after they are done
+    CHECK(prefetchPages(bm, whole, 4));
+    ASSERT_EQUALS_POOL("[2 0],[1 0],[0 0],[4 0]", bm, "prefetches fill the whole pool");
+    CHECK(pinPage(bm, h, 7));
+    ASSERT_EQUALS_STRING("Page-7", h->data, "page pinned while the pool was being prefetched");
+    CHECK(unpinPage(bm, h));
+    CHECK(prefetchPages(bm, whole, 4));
+    usleep(100000);
+    CHECK(pinPage(bm, h, 8));
+    ASSERT_EQUALS_STRING("Page-8", h->data, "page pinned after the prefetches arrived");
+    CHECK(unpinPage(bm, h));
+    CHECK(shutdownBufferPool(bm));
+    CHECK(destroyPageFile("testbuffer.bin"));
+    
+    free(bm);
+    free(h);
+    TEST_DONE();
+}
+
+// the prefetcher loads pages along a stride once it repeated, and pages that followed
+// each other twice before
+void
+testPrefetcher (void)
+{
+    const PageNumber pages[] = { 84, 71, 87, 94, 119, 79, 88, 98, 70, 100, 122, 64, 110, 77, 90, 81 };
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    BM_PoolOptions options;
+    int i, round, hits;
+    testName = "Testing the stride and correlation prefetcher";
+    
+    CHECK(createPageFile("testbuffer.bin"));
+    createDummyPages(bm, 128);
+    initPoolOptions(&options);
+    options.prefetcher = true;
+    CHECK(initBufferPoolWithOptions(bm, "testbuffer.bin", 8, RS_LRU, NULL, &options));
+    for (i = 0; i < 60; i += 3)
+        touchPage(bm, h, i, 1);
+    ASSERT_EQUALS_INT(17, getNumPrefetchHits(bm), "pages along the stride loaded after it repeated");
+    
+    for (round = 0; round < 3; round++)
+    {
+        hits = getNumPrefetchHits(bm);
+        for (i = 0; i < 16; i++)
+            touchPage(bm, h, pages[i], 1);
+    }
+    ASSERT_EQUALS_INT(15, getNumPrefetchHits(bm) - hits, "all but the first page of the third round loaded ahead");
+    CHECK(shutdownBufferPool(bm));
+    CHECK(destroyPageFile("testbuffer.bin"));
+    
+    free(bm);
+    free(h);
+    TEST_DONE();
+}
+
+// state of the MRU policy registered by testCustomPolicy, the test owns it
+typedef struct MRUState {
+    long now;
+    long used[3];
+    int loads;
+    int evictions;
+} MRUState;
+
+static void
+mruLoad (void *state, int frame, PageNumber pageNum)
+{
+    MRUState *s = state;
+    
+    s->loads++;
+    s->used[frame] = ++s->now;
+}
+
+static void
+mruHit (void *state, int frame)
+{
+    MRUState *s = state;
+    
+    s->used[frame] = ++s->now;
+}
+
+static void
+mruEvict (void *state, int frame)
+{
+    ((MRUState *) state)->evictions++;
+}
+
+// the most recently used unpinned frame
+static int
+mruPickVictim (void *state, BM_BufferPool *const bm, PageNumber pageNum)
+{
+    MRUState *s = state;
+    int i, victim = -1;
+    
+    for (i = 0; i < 3; i++)
+        if (!isFramePinned(bm, i) && (victim < 0 || s->used[i] > s->used[victim]))
+            victim = i;
+    return victim;
+}
+
+// a policy passed as stratData with RS_CUSTOM sees every load, hit and eviction and
+// chooses the victims
+void
+testCustomPolicy (void)
+{
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    MRUState mru = { 0 };
+    BM_ReplacementPolicy policy = { "MRU", NULL, NULL, mruLoad, mruHit, NULL, mruEvict, mruPickVictim, NULL, &mru };
+    testName = "Testing a custom replacement policy";
+    
+    CHECK(createPageFile("testbuffer.bin"));
+    CHECK(initBufferPool(bm, "testbuffer.bin", 3, RS_CUSTOM, &policy));
+    touchPage(bm, h, 0, 1);
+    touchPage(bm, h, 1, 1);
+    touchPage(bm, h, 2, 1);
+    touchPage(bm, h, 1, 1);
+    touchPage(bm, h, 3, 1);
+    ASSERT_EQUALS_POOL("[0 0],[3 0],[2 0]", bm, "most recently used page replaced");
+    CHECK(pinPage(bm, h, 3));
+    touchPage(bm, h, 4, 1);
+    ASSERT_EQUALS_POOL("[0 0],[3 1],[4 0]", bm, "pinned page skipped");
+    CHECK(unpinPage(bm, h));
+    ASSERT_EQUALS_INT(5, mru.loads, "one load per miss");
+    ASSERT_EQUALS_INT(2, mru.evictions, "one eviction per replaced page");
+    CHECK(shutdownBufferPool(bm));
+    CHECK(destroyPageFile("testbuffer.bin"));
+    
+    free(bm);
+    free(h);
+    TEST_DONE();
+}
+
 // test the LRU_K page replacement strategy
 void
 testLRU_K (void)
@@ -87,12 +1024,13 @@ testLRU_K (void)
         "[0 0],[1 0],[2 0],[3 0],[4 0]",
         "[0 0],[1 0],[2 0],[3 0],[4 0]",
         "[0 0],[1 0],[2 0],[3 0],[4 0]",
-        // check that pages get evicted in LRU_K order
-        "[0 0],[1 0],[2 0],[5 0],[4 0]",
-        "[0 0],[1 0],[2 0],[5 0],[6 0]",
-        "[7 0],[1 0],[2 0],[5 0],[6 0]",
-        "[7 0],[1 0],[8 0],[5 0],[6 0]",
-        "[7 0],[9 0],[8 0],[5 0],[6 0]"
+        // check that pages get evicted in LRU_K order: page 0 has the oldest second
+        // reference, then the new pages, referenced only once, replace each other
+        "[5 0],[1 0],[2 0],[3 0],[4 0]",
+        "[6 0],[1 0],[2 0],[3 0],[4 0]",
+        "[7 0],[1 0],[2 0],[3 0],[4 0]",
+        "[8 0],[1 0],[2 0],[3 0],[4 0]",
+        "[9 0],[1 0],[2 0],[3 0],[4 0]"
     };
     const int orderRequests[] = {3,4,0,2,1};
     const int numLRU_KOrderChange = 5;
@@ -143,6 +1081,50 @@ testLRU_K (void)
     TEST_DONE();
 }
 
+// a page referenced twice survives a scan that touches many other pages once
+void
+testLRU_KScan (void)
+{
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    BM_LRUKParams params = { 2, 1 };
+    int i;
+    testName = "Testing LRU_K scan resistance";
+    
+    CHECK(createPageFile("testbuffer.bin"));
+    CHECK(initBufferPool(bm, "testbuffer.bin", 3, RS_LRU_K, &params));
+    
+    // page 0 gets two references more than one pin apart, page 1 only one
+    CHECK(pinPage(bm, h, 0));
+    CHECK(unpinPage(bm, h));
+    CHECK(pinPage(bm, h, 1));
+    CHECK(unpinPage(bm, h));
+    CHECK(pinPage(bm, h, 0));
+    CHECK(unpinPage(bm, h));
+    
+    for (i = 10; i < 30; i++)
+    {
+        CHECK(pinPage(bm, h, i));
+        CHECK(unpinPage(bm, h));
+    }
+    ASSERT_EQUALS_POOL("[0 0],[29 0],[28 0]", bm, "hot page kept, scan pages replace each other");
+    ASSERT_EQUALS_INT(22, getNumReadIO(bm), "every scan page read once");
+    CHECK(shutdownBufferPool(bm));
+    
+    // the default settings keep hot pages through a scan as well
+    CHECK(initBufferPool(bm, "testbuffer.bin", 10, RS_LRU_K, NULL));
+    for (i = 0; i < 5; i++)
+        touchPage(bm, h, i, 4);
+    for (i = 100; i < 140; i++)
+        touchPage(bm, h, i, 1);
+    ASSERT_EQUALS_POOL("[0 0],[1 0],[2 0],[3 0],[4 0],[135 0],[136 0],[137 0],[138 0],[139 0]", bm,
+                       "hot pages kept with default settings");
+    CHECK(shutdownBufferPool(bm));
+    CHECK(destroyPageFile("testbuffer.bin"));
+    free(bm);
+    free(h);
+    TEST_DONE();
+}
 
 // test error cases
 void